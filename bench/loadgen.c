@@ -0,0 +1,315 @@
+/**
+ * Multi-connection HTTP load generator for benchmarking the server.
+ *
+ * Opens N concurrent keep-alive connections, fires pipelined-free
+ * request/response cycles on each for a fixed duration, and reports
+ * requests/sec, bytes/sec, and latency percentiles from a microsecond
+ * histogram.
+ *
+ * Usage: loadgen [-h host] [-p port] [-c connections] [-d seconds] path
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
+
+#define RECV_BUF_SIZE 65536
+#define MAX_LATENCY_US (10 * 1000 * 1000)  // Latencies cap at 10 s
+
+// One benchmark connection and its in-flight response state
+typedef struct {
+    int fd;
+    int connected;          // Non-blocking connect completed
+    uint64_t started_us;    // When the current request was sent
+    size_t request_sent;    // Bytes of the request written so far
+    // Response parsing
+    char headers[8192];
+    size_t headers_len;
+    int headers_done;
+    long body_remaining;    // From Content-Length
+} bench_conn;
+
+static const char *host = "127.0.0.1";
+static int port = 8080;
+static int num_connections = 50;
+static int duration_seconds = 10;
+static char request[1024];
+static size_t request_len;
+
+// Microsecond latency histogram; index = latency in us, capped
+static uint32_t *histogram;
+static uint64_t total_requests;
+static uint64_t total_bytes;
+static uint64_t max_latency_us;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void record_latency(uint64_t us) {
+    if (us >= MAX_LATENCY_US) {
+        us = MAX_LATENCY_US - 1;
+    }
+    histogram[us]++;
+    if (us > max_latency_us) {
+        max_latency_us = us;
+    }
+    total_requests++;
+}
+
+// Walk the histogram to the given percentile
+static uint64_t percentile(double p) {
+    uint64_t target = (uint64_t)(p * total_requests);
+    uint64_t seen = 0;
+    for (uint64_t us = 0; us < MAX_LATENCY_US; us++) {
+        seen += histogram[us];
+        if (seen >= target) {
+            return us;
+        }
+    }
+    return max_latency_us;
+}
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Begin a non-blocking connect for one benchmark connection
+static int conn_open(bench_conn *conn, int epoll_fd) {
+    conn->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (conn->fd == -1) {
+        perror("socket");
+        return -1;
+    }
+    set_nonblocking(conn->fd);
+
+    int one = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "Invalid host: %s\n", host);
+        return -1;
+    }
+
+    if (connect(conn->fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 &&
+        errno != EINPROGRESS) {
+        perror("connect");
+        close(conn->fd);
+        return -1;
+    }
+
+    conn->connected = 0;
+    conn->request_sent = 0;
+    conn->headers_len = 0;
+    conn->headers_done = 0;
+    conn->body_remaining = 0;
+
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.ptr = conn;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->fd, &event) == -1) {
+        perror("epoll_ctl");
+        close(conn->fd);
+        return -1;
+    }
+    return 0;
+}
+
+// Reset response state and time the next request
+static void conn_next_request(bench_conn *conn) {
+    conn->request_sent = 0;
+    conn->headers_len = 0;
+    conn->headers_done = 0;
+    conn->body_remaining = 0;
+    conn->started_us = now_us();
+}
+
+// Drop and re-dial a connection the server closed
+static void conn_reopen(bench_conn *conn, int epoll_fd) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    if (conn_open(conn, epoll_fd) == -1) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Push out as much of the current request as the socket takes
+static void conn_send(bench_conn *conn) {
+    while (conn->request_sent < request_len) {
+        ssize_t n = write(conn->fd, request + conn->request_sent,
+                          request_len - conn->request_sent);
+        if (n > 0) {
+            conn->request_sent += (size_t)n;
+        } else {
+            return;
+        }
+    }
+}
+
+// Consume response bytes; returns 1 when a full response was received,
+// -1 if the connection died, 0 otherwise
+static int conn_receive(bench_conn *conn) {
+    char buf[RECV_BUF_SIZE];
+    while (1) {
+        ssize_t n = read(conn->fd, buf, sizeof(buf));
+        if (n == 0) {
+            return -1;
+        }
+        if (n == -1) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        total_bytes += (uint64_t)n;
+
+        size_t off = 0;
+        if (!conn->headers_done) {
+            size_t room = sizeof(conn->headers) - 1 - conn->headers_len;
+            size_t copy = (size_t)n < room ? (size_t)n : room;
+            memcpy(conn->headers + conn->headers_len, buf, copy);
+            conn->headers_len += copy;
+            conn->headers[conn->headers_len] = '\0';
+
+            char *body = strstr(conn->headers, "\r\n\r\n");
+            if (body == NULL) {
+                continue;
+            }
+            conn->headers_done = 1;
+
+            long content_length = 0;
+            char *cl = strstr(conn->headers, "Content-Length:");
+            if (cl != NULL && cl < body) {
+                content_length = strtol(cl + 15, NULL, 10);
+            }
+            size_t header_bytes = (size_t)(body - conn->headers) + 4;
+            size_t body_seen = conn->headers_len - header_bytes;
+            conn->body_remaining = content_length - (long)body_seen;
+            off = copy;  // Anything past what headers[] took is body
+        }
+
+        if (conn->headers_done) {
+            if (off < (size_t)n) {
+                conn->body_remaining -= (long)((size_t)n - off);
+            }
+            if (conn->body_remaining <= 0) {
+                return 1;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:c:d:")) != -1) {
+        switch (opt) {
+        case 'h': host = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'c': num_connections = atoi(optarg); break;
+        case 'd': duration_seconds = atoi(optarg); break;
+        default:
+            fprintf(stderr,
+                "Usage: %s [-h host] [-p port] [-c connections] [-d seconds] path\n",
+                argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Missing request path\n");
+        return EXIT_FAILURE;
+    }
+    const char *path = argv[optind];
+
+    request_len = (size_t)snprintf(request, sizeof(request),
+        "GET %s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n",
+        path, host);
+
+    histogram = calloc(MAX_LATENCY_US, sizeof(uint32_t));
+    if (histogram == NULL) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1) {
+        perror("epoll_create1");
+        return EXIT_FAILURE;
+    }
+
+    bench_conn *conns = calloc(num_connections, sizeof(bench_conn));
+    for (int i = 0; i < num_connections; i++) {
+        if (conn_open(&conns[i], epoll_fd) == -1) {
+            return EXIT_FAILURE;
+        }
+        conns[i].started_us = now_us();
+    }
+
+    uint64_t bench_start = now_us();
+    uint64_t bench_end = bench_start + (uint64_t)duration_seconds * 1000000;
+
+    struct epoll_event events[256];
+    while (now_us() < bench_end) {
+        int n = epoll_wait(epoll_fd, events, 256, 100);
+        for (int i = 0; i < n; i++) {
+            bench_conn *conn = events[i].data.ptr;
+
+            if (!conn->connected && (events[i].events & EPOLLOUT)) {
+                conn->connected = 1;
+                conn->started_us = now_us();
+            }
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                conn_reopen(conn, epoll_fd);
+                continue;
+            }
+            if (conn->connected && conn->request_sent < request_len) {
+                conn_send(conn);
+            }
+            if (events[i].events & EPOLLIN) {
+                int done = conn_receive(conn);
+                if (done == 1) {
+                    record_latency(now_us() - conn->started_us);
+                    conn_next_request(conn);
+                    conn_send(conn);
+                } else if (done == -1) {
+                    conn_reopen(conn, epoll_fd);
+                }
+            }
+        }
+    }
+
+    double elapsed = (double)(now_us() - bench_start) / 1e6;
+    printf("connections:    %d\n", num_connections);
+    printf("duration:       %.2f s\n", elapsed);
+    printf("requests:       %llu\n", (unsigned long long)total_requests);
+    printf("requests/sec:   %.0f\n", (double)total_requests / elapsed);
+    printf("bytes/sec:      %.2f MB\n",
+           (double)total_bytes / elapsed / (1024.0 * 1024.0));
+    if (total_requests > 0) {
+        printf("latency p50:    %.3f ms\n", (double)percentile(0.50) / 1000.0);
+        printf("latency p90:    %.3f ms\n", (double)percentile(0.90) / 1000.0);
+        printf("latency p99:    %.3f ms\n", (double)percentile(0.99) / 1000.0);
+        printf("latency p99.9:  %.3f ms\n", (double)percentile(0.999) / 1000.0);
+        printf("latency max:    %.3f ms\n", (double)max_latency_us / 1000.0);
+    }
+    return 0;
+}
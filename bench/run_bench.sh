@@ -0,0 +1,78 @@
+#!/bin/sh
+# Benchmark driver: generates a www tree, starts the server against it,
+# and runs the load generator over representative workloads.
+#
+# Usage: run_bench.sh /path/to/http_server /path/to/loadgen
+
+set -e
+
+SERVER="$1"
+LOADGEN="$2"
+if [ -z "$SERVER" ] || [ -z "$LOADGEN" ]; then
+    echo "Usage: $0 /path/to/http_server /path/to/loadgen" >&2
+    exit 1
+fi
+
+PORT=8080
+BENCH_DIR=$(mktemp -d)
+trap 'kill "$SERVER_PID" 2>/dev/null; rm -rf "$BENCH_DIR"' EXIT INT TERM
+
+# --- Generate the www tree -------------------------------------------------
+mkdir -p "$BENCH_DIR/www"
+
+# Small files: the typical asset workload
+i=0
+while [ "$i" -lt 100 ]; do
+    {
+        printf '<!DOCTYPE html>\n<html><body><h1>File %s</h1>\n' "$i"
+        j=0
+        while [ "$j" -lt 40 ]; do
+            printf '<p>Benchmark filler line %s in file %s.</p>\n' "$j" "$i"
+            j=$((j + 1))
+        done
+        printf '</body></html>\n'
+    } > "$BENCH_DIR/www/file$i.html"
+    i=$((i + 1))
+done
+
+# A large file for the streaming/sendfile path
+dd if=/dev/zero of="$BENCH_DIR/www/large.bin" bs=1M count=64 2>/dev/null
+
+# A PHP script for the dynamic path
+cat > "$BENCH_DIR/www/bench.php" <<'EOF'
+<?php
+    echo "<h1>Benchmark</h1>";
+    for ($i = 0; $i < 100; $i++) {
+        echo "<p>Dynamic line $i</p>";
+    }
+?>
+EOF
+
+# --- Start the server ------------------------------------------------------
+cd "$BENCH_DIR"
+"$SERVER" > server.log 2>&1 &
+SERVER_PID=$!
+sleep 1
+
+if ! kill -0 "$SERVER_PID" 2>/dev/null; then
+    echo "Server failed to start:" >&2
+    cat server.log >&2
+    exit 1
+fi
+
+# --- Run the workloads -----------------------------------------------------
+echo "=== Small file, 50 connections ==="
+"$LOADGEN" -p "$PORT" -c 50 -d 5 /file42.html
+echo
+
+echo "=== Large file (64 MB), 4 connections ==="
+"$LOADGEN" -p "$PORT" -c 4 -d 5 /large.bin
+echo
+
+if command -v php > /dev/null 2>&1; then
+    echo "=== PHP script, 8 connections ==="
+    "$LOADGEN" -p "$PORT" -c 8 -d 5 /bench.php
+    echo
+else
+    echo "=== PHP not installed; skipping dynamic workload ==="
+fi
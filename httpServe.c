@@ -1,424 +1,4597 @@
-/**
- * HTTP Server in C that serves HTML files and handles PHP scripts
- * 
- * This server handles GET requests and can:
- * - Serve static HTML files from a "www" directory
- * - Execute PHP scripts using the PHP CLI
- * 
- * Compile with: gcc -o http_server http_server.c
- * Run with: ./http_server
- * 
- * Before running, create a "www" directory in the same location as your executable
- * and place your HTML and PHP files there.
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <sys/wait.h>
-#include <ctype.h>
-
-#define PORT 8080
-#define BUFFER_SIZE 4096
-#define MAX_PATH_LENGTH 256
-#define WWW_DIRECTORY "./www"
-#define PHP_CLI "/usr/bin/php"  // Path to PHP CLI executable
-
-// Helper function to check if a file exists
-int file_exists(const char *path) {
-    struct stat buffer;
-    return (stat(path, &buffer) == 0);
-}
-
-// Helper function to get file extension
-const char* get_file_extension(const char *filename) {
-    const char *dot = strrchr(filename, '.');
-    if (!dot || dot == filename) {
-        return "";
-    }
-    return dot + 1;
-}
-
-// Helper function to determine content type based on file extension
-const char* get_content_type(const char *extension) {
-    if (strcmp(extension, "html") == 0 || strcmp(extension, "htm") == 0) {
-        return "text/html";
-    } else if (strcmp(extension, "css") == 0) {
-        return "text/css";
-    } else if (strcmp(extension, "js") == 0) {
-        return "application/javascript";
-    } else if (strcmp(extension, "jpg") == 0 || strcmp(extension, "jpeg") == 0) {
-        return "image/jpeg";
-    } else if (strcmp(extension, "png") == 0) {
-        return "image/png";
-    } else if (strcmp(extension, "gif") == 0) {
-        return "image/gif";
-    } else if (strcmp(extension, "txt") == 0) {
-        return "text/plain";
-    } else if (strcmp(extension, "php") == 0) {
-        return "text/html";  // PHP output is typically HTML
-    } else {
-        return "application/octet-stream";
-    }
-}
-
-// Parse HTTP request to extract the path
-char* get_request_path(const char *request) {
-    static char path[MAX_PATH_LENGTH];
-    
-    // Find the GET request line
-    char *get_pos = strstr(request, "GET ");
-    if (get_pos == NULL) {
-        // Not a GET request
-        strcpy(path, "/");
-        return path;
-    }
-    
-    // Extract the path
-    char *path_start = get_pos + 4;  // Skip "GET "
-    char *path_end = strstr(path_start, " ");
-    if (path_end == NULL) {
-        strcpy(path, "/");
-        return path;
-    }
-    
-    // Copy the path
-    size_t path_length = path_end - path_start;
-    if (path_length >= MAX_PATH_LENGTH) {
-        path_length = MAX_PATH_LENGTH - 1;
-    }
-    strncpy(path, path_start, path_length);
-    path[path_length] = '\0';
-    
-    // URL decode the path
-    // Simple decoding for spaces only
-    char *src = path;
-    char *dst = path;
-    while (*src) {
-        if (strncmp(src, "%20", 3) == 0) {
-            *dst++ = ' ';
-            src += 3;
-        } else {
-            *dst++ = *src++;
-        }
-    }
-    *dst = '\0';
-    
-    return path;
-}
-
-// Send a 404 Not Found response
-void send_not_found(int client_socket) {
-    const char *response = 
-        "HTTP/1.1 404 Not Found\r\n"
-        "Content-Type: text/html\r\n"
-        "Connection: close\r\n"
-        "\r\n"
-        "<html><body>"
-        "<h1>404 Not Found</h1>"
-        "<p>The requested resource could not be found on this server.</p>"
-        "</body></html>";
-    
-    write(client_socket, response, strlen(response));
-}
-
-// Send a 500 Internal Server Error response
-void send_server_error(int client_socket) {
-    const char *response = 
-        "HTTP/1.1 500 Internal Server Error\r\n"
-        "Content-Type: text/html\r\n"
-        "Connection: close\r\n"
-        "\r\n"
-        "<html><body>"
-        "<h1>500 Internal Server Error</h1>"
-        "<p>The server encountered an error while processing your request.</p>"
-        "</body></html>";
-    
-    write(client_socket, response, strlen(response));
-}
-
-// Execute a PHP script and send the output to the client
-void serve_php(int client_socket, const char *file_path) {
-    printf("Executing PHP script: %s\n", file_path);
-    
-    // Create a pipe to capture the output of the PHP process
-    int pipe_fd[2];
-    if (pipe(pipe_fd) == -1) {
-        perror("Failed to create pipe");
-        send_server_error(client_socket);
-        return;
-    }
-    
-    // Fork a child process to execute the PHP script
-    pid_t pid = fork();
-    if (pid == -1) {
-        // Fork failed
-        perror("Failed to fork process");
-        close(pipe_fd[0]);
-        close(pipe_fd[1]);
-        send_server_error(client_socket);
-        return;
-    }
-    
-    if (pid == 0) {
-        // This is the child process
-        // Redirect stdout to the pipe
-        close(pipe_fd[0]);  // Close read end
-        dup2(pipe_fd[1], STDOUT_FILENO);
-        close(pipe_fd[1]);
-        
-        // Execute the PHP script
-        execl(PHP_CLI, PHP_CLI, file_path, NULL);
-        
-        // If execl returns, it failed
-        perror("Failed to execute PHP");
-        exit(EXIT_FAILURE);
-    } else {
-        // This is the parent process
-        close(pipe_fd[1]);  // Close write end
-        
-        // Send HTTP headers
-        const char *headers = 
-            "HTTP/1.1 200 OK\r\n"
-            "Content-Type: text/html\r\n"
-            "Connection: close\r\n"
-            "\r\n";
-        write(client_socket, headers, strlen(headers));
-        
-        // Read from the pipe and send to the client
-        char buffer[BUFFER_SIZE];
-        ssize_t bytes_read;
-        while ((bytes_read = read(pipe_fd[0], buffer, BUFFER_SIZE)) > 0) {
-            write(client_socket, buffer, bytes_read);
-        }
-        
-        close(pipe_fd[0]);
-        
-        // Wait for the child process to finish
-        int status;
-        waitpid(pid, &status, 0);
-        
-        if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-            printf("PHP script exited with status %d\n", WEXITSTATUS(status));
-        }
-    }
-}
-
-// Serve a static file
-void serve_file(int client_socket, const char *file_path) {
-    printf("Serving file: %s\n", file_path);
-    
-    // Get file extension
-    const char *extension = get_file_extension(file_path);
-    const char *content_type = get_content_type(extension);
-    
-    // Open the file
-    int file_fd = open(file_path, O_RDONLY);
-    if (file_fd == -1) {
-        perror("Failed to open file");
-        send_not_found(client_socket);
-        return;
-    }
-    
-    // Get file size
-    struct stat file_stat;
-    if (fstat(file_fd, &file_stat) == -1) {
-        perror("Failed to get file stats");
-        close(file_fd);
-        send_server_error(client_socket);
-        return;
-    }
-    
-    // Send HTTP headers
-    char headers[BUFFER_SIZE];
-    snprintf(headers, BUFFER_SIZE,
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: %s\r\n"
-        "Content-Length: %ld\r\n"
-        "Connection: close\r\n"
-        "\r\n",
-        content_type, file_stat.st_size);
-    write(client_socket, headers, strlen(headers));
-    
-    // Send file content
-    char buffer[BUFFER_SIZE];
-    ssize_t bytes_read;
-    while ((bytes_read = read(file_fd, buffer, BUFFER_SIZE)) > 0) {
-        write(client_socket, buffer, bytes_read);
-    }
-    
-    close(file_fd);
-}
-
-void handle_client(int client_socket) {
-    char buffer[BUFFER_SIZE] = {0};
-    
-    // Read request
-    ssize_t bytes_read = read(client_socket, buffer, BUFFER_SIZE - 1);
-    if (bytes_read <= 0) {
-        close(client_socket);
-        return;
-    }
-    
-    // Print request information
-    printf("Received request:\n%s\n", buffer);
-    
-    // Get the requested path
-    char *request_path = get_request_path(buffer);
-    printf("Requested path: %s\n", request_path);
-    
-    // Construct the file path
-    char file_path[MAX_PATH_LENGTH];
-    snprintf(file_path, MAX_PATH_LENGTH, "%s%s", WWW_DIRECTORY, request_path);
-    
-    // If the path ends with a slash, try to serve index.html or index.php
-    if (request_path[strlen(request_path) - 1] == '/') {
-        char index_html_path[MAX_PATH_LENGTH];
-        char index_php_path[MAX_PATH_LENGTH];
-        
-        snprintf(index_html_path, MAX_PATH_LENGTH, "%s/index.html", file_path);
-        snprintf(index_php_path, MAX_PATH_LENGTH, "%s/index.php", file_path);
-        
-        if (file_exists(index_html_path)) {
-            serve_file(client_socket, index_html_path);
-        } else if (file_exists(index_php_path)) {
-            serve_php(client_socket, index_php_path);
-        } else {
-            send_not_found(client_socket);
-        }
-    } else {
-        // Check if the file exists
-        if (file_exists(file_path)) {
-            // Check if it's a PHP file
-            const char *extension = get_file_extension(file_path);
-            if (strcasecmp(extension, "php") == 0) {
-                serve_php(client_socket, file_path);
-            } else {
-                serve_file(client_socket, file_path);
-            }
-        } else {
-            send_not_found(client_socket);
-        }
-    }
-    
-    close(client_socket);
-}
-
-int main() {
-    int server_fd, client_socket;
-    struct sockaddr_in address;
-    int addrlen = sizeof(address);
-    
-    // Check if PHP is installed
-    if (access(PHP_CLI, X_OK) != 0) {
-        printf("Warning: PHP CLI (%s) not found or not executable.\n", PHP_CLI);
-        printf("PHP scripts will not be processed correctly.\n");
-        printf("Please install PHP or update the PHP_CLI path in the code.\n\n");
-    }
-    
-    // Create www directory if it doesn't exist
-    struct stat st = {0};
-    if (stat(WWW_DIRECTORY, &st) == -1) {
-        printf("Creating www directory...\n");
-        mkdir(WWW_DIRECTORY, 0700);
-        
-        // Create a sample index.html file
-        char index_path[MAX_PATH_LENGTH];
-        snprintf(index_path, MAX_PATH_LENGTH, "%s/index.html", WWW_DIRECTORY);
-        FILE *index_file = fopen(index_path, "w");
-        if (index_file) {
-            fprintf(index_file, 
-                "<!DOCTYPE html>\n"
-                "<html>\n"
-                "<head>\n"
-                "    <title>Welcome to C HTTP Server</title>\n"
-                "</head>\n"
-                "<body>\n"
-                "    <h1>Welcome to C HTTP Server</h1>\n"
-                "    <p>This is a sample HTML file being served by your C HTTP server.</p>\n"
-                "    <p>Place your HTML files in the 'www' directory to serve them.</p>\n"
-                "</body>\n"
-                "</html>\n");
-            fclose(index_file);
-            printf("Created sample index.html file.\n");
-        }
-        
-        // Create a sample PHP file
-        char php_path[MAX_PATH_LENGTH];
-        snprintf(php_path, MAX_PATH_LENGTH, "%s/info.php", WWW_DIRECTORY);
-        FILE *php_file = fopen(php_path, "w");
-        if (php_file) {
-            fprintf(php_file, 
-                "<?php\n"
-                "    echo \"<h1>PHP is working!</h1>\";\n"
-                "    echo \"<p>This is generated by PHP running on your C HTTP server.</p>\";\n"
-                "    echo \"<h2>PHP Information</h2>\";\n"
-                "    phpinfo();\n"
-                "?>\n");
-            fclose(php_file);
-            printf("Created sample info.php file.\n");
-        }
-    }
-
-    // Create socket file descriptor
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        perror("Socket creation failed");
-        exit(EXIT_FAILURE);
-    }
-    
-    // Set socket options to reuse address
-    int opt = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
-        perror("Setsockopt failed");
-        exit(EXIT_FAILURE);
-    }
-    
-    // Setup server address structure
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
-    
-    // Bind socket to the port
-    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
-        perror("Bind failed");
-        exit(EXIT_FAILURE);
-    }
-    
-    // Listen for connections
-    if (listen(server_fd, 10) < 0) {
-        perror("Listen failed");
-        exit(EXIT_FAILURE);
-    }
-    
-    printf("Server started at http://localhost:%d\n", PORT);
-    printf("Serving files from %s\n", WWW_DIRECTORY);
-    printf("Try visiting: http://localhost:%d/ for the HTML sample\n", PORT);
-    printf("Try visiting: http://localhost:%d/info.php for the PHP sample\n", PORT);
-    printf("Press Ctrl+C to stop the server\n");
-    
-    // Accept and process connections
-    while (1) {
-        printf("Waiting for connections...\n");
-        
-        if ((client_socket = accept(server_fd, (struct sockaddr*)&address, (socklen_t*)&addrlen)) < 0) {
-            perror("Accept failed");
-            continue;
-        }
-        
-        // Get client info
-        char client_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &(address.sin_addr), client_ip, INET_ADDRSTRLEN);
-        printf("Client connected: %s:%d\n", client_ip, ntohs(address.sin_port));
-        
-        // Handle client
-        handle_client(client_socket);
-    }
-    
-    return 0;
-}
\ No newline at end of file
+/**
+ * HTTP Server in C that serves HTML files and handles PHP scripts
+ *
+ * This server handles GET requests and can:
+ * - Serve static HTML files from a "www" directory
+ * - Execute PHP scripts using the PHP CLI
+ *
+ * The server runs a non-blocking, edge-triggered epoll event loop: accepts,
+ * reads, and writes are multiplexed across all connected sockets, and each
+ * connection carries its own state machine so a slow client never stalls
+ * the rest of the server.
+ *
+ * Compile with: gcc -o http_server httpServe.c
+ * Run with: ./http_server
+ *
+ * Before running, create a "www" directory in the same location as your executable
+ * and place your HTML and PHP files there.
+ */
+
+#define _GNU_SOURCE  // strcasestr
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <dirent.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <time.h>
+
+#define PORT 8080
+#define BUFFER_SIZE 4096
+#define MAX_PATH_LENGTH 256
+#define MAX_EVENTS 64
+#define HEADER_BUF_SIZE 1024
+#define WORKER_QUEUE_CAPACITY 1024
+#define WWW_DIRECTORY "./www"
+#define PHP_CLI "/usr/bin/php"  // Path to PHP CLI executable
+
+// Connection deadlines, enforced by a per-reactor timer wheel with
+// one-second ticks. The wheel must have more slots than the longest
+// timeout so a deadline can never wrap past the cursor.
+#define TIMER_WHEEL_SLOTS 128
+#define READ_TIMEOUT_SECONDS 30       // Connect until the request is complete
+#define WRITE_TIMEOUT_SECONDS 30      // Request complete until response sent
+#define KEEPALIVE_TIMEOUT_SECONDS 60  // Idle between requests
+
+#define FILE_CACHE_SLOTS 256                    // Direct-mapped, power of two
+#define FILE_CACHE_MAX_FILE_SIZE (1024 * 1024)  // Only cache files up to 1 MB
+#define FILE_CACHE_RECHECK_SECONDS 2            // Re-stat a hit at most this often
+
+// Bodies larger than the file cache limit go out in an adaptive window
+// with explicit page-cache advice (see conn_stream_advise). The window
+// grows while the socket keeps draining and shrinks when it backs up.
+#define STREAM_CHUNK_MIN (64 * 1024)
+#define STREAM_CHUNK_MAX (1024 * 1024)
+
+// FastCGI transport to a pool of persistent php-fpm workers. When the
+// socket is absent or a request fails, serve_php() falls back to
+// fork/exec of PHP_CLI.
+#define FCGI_SOCKET_PATH "/run/php/php-fpm.sock"
+#define FCGI_POOL_SIZE 8          // Idle connections kept for reuse
+#define FCGI_TIMEOUT_SECONDS 10   // Per-request read timeout
+
+// Streamed (chunked) PHP bodies flush to the socket once this much is
+// queued, bounding the buffer a response of any size passes through
+#define PHP_STREAM_FLUSH_BYTES (64 * 1024)
+
+#define FCGI_VERSION_1 1
+#define FCGI_BEGIN_REQUEST 1
+#define FCGI_END_REQUEST 3
+#define FCGI_PARAMS 4
+#define FCGI_STDIN 5
+#define FCGI_STDOUT 6
+#define FCGI_STDERR 7
+#define FCGI_RESPONDER 1
+#define FCGI_KEEP_CONN 1
+
+#define MAX_HEADERS 32
+
+// One parsed request header; name and value point into the connection's
+// input buffer and are not NUL-terminated
+typedef struct {
+    const char *name;
+    size_t name_len;
+    const char *value;
+    size_t value_len;
+} http_header;
+
+// A fully parsed request line and header block
+typedef struct {
+    char method[16];
+    char target[MAX_PATH_LENGTH];  // Raw request target, before URL decoding
+    int minor_version;             // 0 for HTTP/1.0, 1 for HTTP/1.1
+    http_header headers[MAX_HEADERS];
+    int num_headers;
+    long content_length;           // -1 when no Content-Length header
+    int keep_alive;                // Negotiated from version + Connection
+} http_request;
+
+// Per-connection state machine states
+typedef enum {
+    CONN_TLS_HANDSHAKE,  // TLS only: handshake stepping on the worker pool
+    CONN_READING,        // Accumulating the request into in_buf
+    CONN_PROCESSING,     // A worker thread is building the response
+    CONN_WRITING,        // Draining out_buf (and any file body) to the socket
+} conn_state;
+
+// All state for one client connection. The event loop owns these; nothing
+// here is shared between connections, so partial reads and writes on one
+// socket never block progress on another.
+typedef struct connection {
+    int fd;
+    conn_state state;
+    char remote_addr[INET_ADDRSTRLEN];  // Peer IP, for access logging
+
+    // Request accumulation. Pipelined requests queue up behind the one
+    // being processed; request_len marks where the current one ends, and
+    // scan_offset is how far the header-terminator scan has progressed so
+    // partial reads never rescan from the start.
+    char in_buf[BUFFER_SIZE];
+    size_t in_len;
+    size_t request_len;
+    size_t scan_offset;
+
+    // The parsed current request, and whether parsing rejected it
+    http_request request;
+    int bad_request;
+
+    // Whether the connection stays open after the current response
+    int keep_alive;
+
+    // HEAD request: run the full response logic, emit no body
+    int head_only;
+
+    // TLS session state. ssl is NULL on plain connections. After the
+    // handshake, tls_userspace says whether kTLS offload engaged: when
+    // it did, the kernel socket carries the crypto and every raw
+    // read/write/sendfile path below works unchanged; when it did not,
+    // I/O detours through SSL_read/SSL_write.
+    SSL *ssl;
+    int tls_established;
+    int tls_userspace;
+    int tls_want_write;  // Handshake is waiting for socket writability
+
+    // Instrumentation for the current request: when it became complete,
+    // the response status, and bytes actually written to the socket
+    uint64_t request_start_us;
+    int status;
+    uint64_t resp_bytes;
+
+    // Response assembly. Headers build in their own fixed buffer and the
+    // in-memory body (if any) in out_buf; conn_flush() hands both to the
+    // kernel in a single writev() instead of one syscall each. out_buf
+    // lives in the connection's arena until a body outgrows it.
+    char header_buf[HEADER_BUF_SIZE];
+    size_t header_len;
+    size_t header_sent;
+    char *out_buf;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_capacity;
+    int out_in_arena;
+
+    // Bump cursor into the arena that trails this struct in its slab;
+    // resetting it releases every request-scoped allocation at once
+    size_t arena_used;
+
+    // Optional file body that follows the buffers. The offset is kept
+    // here rather than in the descriptor so a pooled descriptor can be
+    // shared between connections streaming the same file.
+    int file_fd;
+    off_t file_offset;
+    off_t file_remaining;
+
+    // Large-file streaming mode: adaptive send window plus page-cache
+    // stewardship, so one big download cannot evict the hot working set
+    int stream_mode;
+    size_t stream_chunk;     // Current send window, drain-rate adapted
+    off_t stream_drop_mark;  // Pages before this offset have been dropped
+    int corked;  // TCP_CORK is set while headers + file body coalesce
+
+    // io_uring engine only: whether a RECV or a POLLOUT is in flight for
+    // this connection, so neither side is armed twice and teardown can
+    // tell when an operation still references the socket
+    int read_armed;
+    int write_armed;
+
+    // Ownership handoff. in_worker is touched only by the event loop: set
+    // when the connection is queued for a worker, cleared when the
+    // completion comes back. defunct is set by the event loop if the
+    // socket errors out in between; the completion handler then closes it.
+    int in_worker;
+    int defunct;
+
+    // Link for the worker -> event loop completion list
+    struct connection *next_done;
+
+    // Timer wheel membership; touched only by the owning event loop
+    struct connection *timer_prev;
+    struct connection *timer_next;
+    time_t deadline;
+    int timer_slot;
+    int timer_armed;
+
+    // The reactor whose event loop owns this connection
+    struct reactor *owner;
+} connection;
+
+// One event loop. In multi-reactor mode each reactor has its own epoll
+// instance and its own listening socket bound with SO_REUSEPORT, so the
+// kernel spreads incoming connections across reactors with no shared
+// accept path.
+typedef struct reactor {
+    pthread_t thread;
+    int epoll_fd;
+    int listen_fd;
+
+    // Completed connections flow back from the workers through this list;
+    // completion_event_fd wakes the reactor up to drain it
+    pthread_mutex_t completion_lock;
+    connection *completion_head;
+    int completion_event_fd;
+
+    // Hashed timer wheel: bucket per second, connections chained per
+    // bucket, reaped as the cursor sweeps forward. Event loop only.
+    connection *timer_wheel[TIMER_WHEEL_SLOTS];
+    time_t timer_cursor;
+} reactor;
+
+// One request-handling worker. Each worker owns a bounded ring of ready
+// connections guarded by its own lock; idle workers steal from the head of
+// a busy worker's ring, so there is no global run queue and no global lock.
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t has_work;
+    connection *queue[WORKER_QUEUE_CAPACITY];
+    size_t head;  // Steal end (oldest)
+    size_t tail;  // Owner end (newest)
+} worker;
+
+static worker *workers;
+static int num_workers;
+static unsigned int next_worker;  // Round-robin dispatch cursor
+
+static reactor *reactors;
+static int num_reactors = 1;
+static int use_uring;  // --engine uring: completion-driven accept/read path
+
+// Prefork mode (--prefork N): a supervisor process runs N exec'd worker
+// processes, each a full copy of the server sharing the port through
+// SO_REUSEPORT. On SIGTERM a worker drains: it stops accepting, finishes
+// the connections it already holds, and exits when none remain.
+static int num_prefork;       // --prefork N: worker process count
+static int prefork_child;     // This process is a prefork worker
+static volatile sig_atomic_t graceful_shutdown;
+static int active_connections;  // Live client sockets, for the drain
+
+static void uring_queue_recv(connection *conn);
+static void uring_queue_pollout(connection *conn);
+
+static char completion_marker;  // epoll data tag for a completion eventfd
+
+// TLS listener context. NULL unless --tls-cert/--tls-key were given, in
+// which case every accepted connection speaks TLS.
+static SSL_CTX *tls_ctx;
+static const char *tls_cert_file;
+static const char *tls_key_file;
+
+// Connection slab pool. Every connection occupies one fixed-size slab:
+// the connection struct at the base and a bump-pointer arena in the
+// remainder for request-scoped allocations. One slab per connection
+// makes the memory footprint exact — capacity per GB of RAM is just
+// division — and freed slabs go on a free list instead of back to
+// malloc, so connection churn costs a list pop and push.
+#define CONN_SLAB_SIZE (16 * 1024)
+#define CONN_ARENA_CAPACITY (CONN_SLAB_SIZE - sizeof(connection))
+
+typedef struct conn_slab {
+    struct conn_slab *next;
+} conn_slab;
+
+static conn_slab *conn_slab_pool;
+static pthread_mutex_t conn_slab_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static connection *conn_alloc(void) {
+    pthread_mutex_lock(&conn_slab_lock);
+    conn_slab *slab = conn_slab_pool;
+    if (slab != NULL) {
+        conn_slab_pool = slab->next;
+    }
+    pthread_mutex_unlock(&conn_slab_lock);
+
+    if (slab == NULL) {
+        slab = malloc(CONN_SLAB_SIZE);
+        if (slab == NULL) {
+            return NULL;
+        }
+    }
+    connection *conn = (connection *)slab;
+    memset(conn, 0, sizeof(*conn));
+    return conn;
+}
+
+static void conn_slab_free(connection *conn) {
+    conn_slab *slab = (conn_slab *)conn;
+    pthread_mutex_lock(&conn_slab_lock);
+    slab->next = conn_slab_pool;
+    conn_slab_pool = slab;
+    pthread_mutex_unlock(&conn_slab_lock);
+}
+
+// How much of the connection's arena is still free (after alignment)
+static size_t conn_arena_avail(connection *conn) {
+    size_t used = (conn->arena_used + 15) & ~(size_t)15;
+    return used < CONN_ARENA_CAPACITY ? CONN_ARENA_CAPACITY - used : 0;
+}
+
+// Request-scoped allocation: bump the arena cursor, 16-byte aligned.
+// Returns NULL when the arena is exhausted; callers fall back to the
+// heap. Everything is released together when arena_used resets.
+static void *conn_arena_alloc(connection *conn, size_t size) {
+    size_t used = (conn->arena_used + 15) & ~(size_t)15;
+    if (used > CONN_ARENA_CAPACITY || size > CONN_ARENA_CAPACITY - used) {
+        return NULL;
+    }
+    void *p = (char *)(conn + 1) + used;
+    conn->arena_used = used + size;
+    return p;
+}
+
+// Request metrics, recorded per thread so the hot path is a handful of
+// plain increments on thread-private cachelines — no locks, no atomics.
+// GET /metrics aggregates across all slots; a reader may see a counter
+// mid-increment, which is harmless for monitoring.
+#define METRICS_MAX_THREADS 64
+#define METRICS_BUCKETS 22  // log2 microsecond buckets: 1 us .. ~2 s, then +Inf
+
+static const int metrics_status_codes[] = {200, 204, 206, 304, 400,
+                                           404, 405, 416, 500};
+#define METRICS_NUM_STATUS \
+    ((int)(sizeof(metrics_status_codes) / sizeof(metrics_status_codes[0])))
+
+typedef struct {
+    uint64_t by_status[METRICS_NUM_STATUS];
+    uint64_t bytes_sent;
+    uint64_t latency_buckets[METRICS_BUCKETS];
+    uint64_t latency_sum_us;
+    uint64_t latency_count;
+} __attribute__((aligned(64))) thread_metrics;
+
+static thread_metrics metrics_slots[METRICS_MAX_THREADS];
+static int metrics_used_slots;
+static __thread thread_metrics *my_metrics;
+
+static uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Each recording thread claims one slot on first use
+static thread_metrics *metrics_self(void) {
+    if (my_metrics == NULL) {
+        int slot = __atomic_fetch_add(&metrics_used_slots, 1, __ATOMIC_RELAXED);
+        if (slot >= METRICS_MAX_THREADS) {
+            slot = METRICS_MAX_THREADS - 1;  // Shared overflow slot
+        }
+        my_metrics = &metrics_slots[slot];
+    }
+    return my_metrics;
+}
+
+// Record one finished request; called on the event loop's hot path, so
+// this is just increments into the thread's own slot
+static void metrics_record(int status, uint64_t bytes, uint64_t latency_us) {
+    thread_metrics *m = metrics_self();
+
+    for (int i = 0; i < METRICS_NUM_STATUS; i++) {
+        if (metrics_status_codes[i] == status) {
+            m->by_status[i]++;
+            break;
+        }
+    }
+    m->bytes_sent += bytes;
+
+    int bucket = 64 - __builtin_clzll(latency_us | 1);
+    if (bucket >= METRICS_BUCKETS) {
+        bucket = METRICS_BUCKETS - 1;
+    }
+    m->latency_buckets[bucket]++;
+    m->latency_sum_us += latency_us;
+    m->latency_count++;
+}
+
+// Asynchronous logging. Request-path threads format a line into a stack
+// buffer and push it through a lock-free bounded MPSC ring; a dedicated
+// logger thread drains the ring and writes batches to stdout. The hot
+// path never takes a lock and never makes a write() syscall of its own.
+// When the ring is full the line is dropped and counted rather than
+// stalling request processing.
+#define LOG_RING_SIZE 4096        // Entries; must be a power of two
+#define LOG_LINE_MAX 256
+#define LOG_BATCH_MAX (64 * 1024) // Logger thread's write() batch
+
+// One ring cell. seq is the handoff protocol: cell i starts at i, a
+// producer that filled position pos publishes pos + 1, and the consumer
+// recycles the cell to pos + LOG_RING_SIZE once written out.
+typedef struct {
+    uint64_t seq;
+    size_t len;
+    char line[LOG_LINE_MAX];
+} log_cell;
+
+static log_cell log_ring[LOG_RING_SIZE];
+static uint64_t log_tail;     // Producer claim cursor (CAS)
+static uint64_t log_head;     // Consumer cursor; logger thread only
+static uint64_t log_dropped;  // Lines lost to a full ring
+static pthread_t logger_thread;
+static int quiet;             // --quiet: suppress per-request debug lines
+
+static void log_ring_init(void) {
+    for (uint64_t i = 0; i < LOG_RING_SIZE; i++) {
+        log_ring[i].seq = i;
+    }
+}
+
+// Claim a cell, copy the line in, and publish it. Multi-producer safe;
+// returns immediately (dropping the line) when the ring is full.
+static void log_enqueue(const char *line, size_t len) {
+    uint64_t pos = __atomic_load_n(&log_tail, __ATOMIC_RELAXED);
+    log_cell *cell;
+    while (1) {
+        cell = &log_ring[pos & (LOG_RING_SIZE - 1)];
+        uint64_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        int64_t dif = (int64_t)(seq - pos);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&log_tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            // The cell still holds an unconsumed line: ring is full
+            __atomic_fetch_add(&log_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&log_tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (len > LOG_LINE_MAX - 1) {
+        len = LOG_LINE_MAX - 1;
+    }
+    memcpy(cell->line, line, len);
+    cell->line[len] = '\n';
+    cell->len = len + 1;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+// printf-style log line (newline appended by the ring)
+static void log_printf(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+static void log_printf(const char *fmt, ...) {
+    char line[LOG_LINE_MAX];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (len < 0) {
+        return;
+    }
+    if ((size_t)len > sizeof(line) - 1) {
+        len = sizeof(line) - 1;
+    }
+    log_enqueue(line, (size_t)len);
+}
+
+// Per-request debug chatter; dropped entirely under --quiet
+static void log_debug(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+static void log_debug(const char *fmt, ...) {
+    if (quiet) {
+        return;
+    }
+    char line[LOG_LINE_MAX];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (len < 0) {
+        return;
+    }
+    if ((size_t)len > sizeof(line) - 1) {
+        len = sizeof(line) - 1;
+    }
+    log_enqueue(line, (size_t)len);
+}
+
+// One structured access line per finished request. The timestamp is
+// re-formatted only when the second ticks over, cached per thread.
+static void log_access(connection *conn, uint64_t latency_us) {
+    static __thread time_t cached_second;
+    static __thread char time_buf[32];
+
+    time_t now = time(NULL);
+    if (now != cached_second) {
+        struct tm tm;
+        localtime_r(&now, &tm);
+        strftime(time_buf, sizeof(time_buf), "%d/%b/%Y:%H:%M:%S %z", &tm);
+        cached_second = now;
+    }
+
+    const char *method = conn->bad_request ? "-" : conn->request.method;
+    const char *target = conn->bad_request ? "-" : conn->request.target;
+    log_printf("%s [%s] \"%s %s\" %d %llu %llu.%03llums",
+               conn->remote_addr, time_buf, method, target, conn->status,
+               (unsigned long long)conn->resp_bytes,
+               (unsigned long long)(latency_us / 1000),
+               (unsigned long long)(latency_us % 1000));
+}
+
+// Logger thread: drain ready cells into one big buffer and hand it to
+// the kernel in a single write(). There is no producer-side wakeup — a
+// syscall per log line is exactly what this design removes — so the
+// thread polls with a short sleep when the ring runs dry.
+static void *logger_main(void *arg) {
+    (void)arg;
+    char batch[LOG_BATCH_MAX];
+
+    while (1) {
+        size_t batch_len = 0;
+
+        while (1) {
+            log_cell *cell = &log_ring[log_head & (LOG_RING_SIZE - 1)];
+            if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) !=
+                log_head + 1) {
+                break;
+            }
+            if (batch_len + cell->len > sizeof(batch)) {
+                if (write(STDOUT_FILENO, batch, batch_len) == -1) {
+                    perror("Log write failed");
+                }
+                batch_len = 0;
+            }
+            memcpy(batch + batch_len, cell->line, cell->len);
+            batch_len += cell->len;
+            __atomic_store_n(&cell->seq, log_head + LOG_RING_SIZE,
+                             __ATOMIC_RELEASE);
+            log_head++;
+        }
+
+        uint64_t dropped = __atomic_exchange_n(&log_dropped, 0,
+                                               __ATOMIC_RELAXED);
+        if (dropped > 0) {
+            int len = snprintf(batch + batch_len,
+                               sizeof(batch) - batch_len,
+                               "[logger] %llu lines dropped (ring full)\n",
+                               (unsigned long long)dropped);
+            if (len > 0 && (size_t)len <= sizeof(batch) - batch_len) {
+                batch_len += (size_t)len;
+            }
+        }
+
+        if (batch_len > 0) {
+            if (write(STDOUT_FILENO, batch, batch_len) == -1) {
+                perror("Log write failed");
+            }
+        } else {
+            struct timespec pause = { .tv_nsec = 5 * 1000 * 1000 };
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+static void start_logger(void) {
+    log_ring_init();
+    if (pthread_create(&logger_thread, NULL, logger_main, NULL) != 0) {
+        perror("Failed to create logger thread");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int stat_cache_lookup(const char *path, struct stat *st_out,
+                             int *fd_out);
+static void stat_cache_store(const char *path, const struct stat *st, int fd);
+
+// Helper function to check if a file exists, via the stat cache
+int file_exists(const char *path) {
+    struct stat buffer;
+    int cached = stat_cache_lookup(path, &buffer, NULL);
+    if (cached != -1) {
+        return cached;
+    }
+    if (stat(path, &buffer) == -1) {
+        stat_cache_store(path, NULL, -1);
+        return 0;
+    }
+    stat_cache_store(path, &buffer, -1);
+    return 1;
+}
+
+// Helper function to get file extension
+const char* get_file_extension(const char *filename) {
+    const char *dot = strrchr(filename, '.');
+    if (!dot || dot == filename) {
+        return "";
+    }
+    return dot + 1;
+}
+
+// MIME type lookup. Extensions are interned: up to 8 lowercased bytes
+// pack into one uint64, so the hot path is a single multiply-shift hash
+// and integer compares — no strcmp chain. The table below is the
+// compile-time source of truth; mime_table_init() spreads it into the
+// hash table once at startup.
+typedef struct {
+    const char *extension;
+    const char *content_type;
+} mime_mapping;
+
+static const mime_mapping mime_types[] = {
+    { "html",  "text/html" },
+    { "htm",   "text/html" },
+    { "css",   "text/css" },
+    { "js",    "application/javascript" },
+    { "mjs",   "application/javascript" },
+    { "json",  "application/json" },
+    { "xml",   "application/xml" },
+    { "txt",   "text/plain" },
+    { "csv",   "text/csv" },
+    { "md",    "text/markdown" },
+    { "jpg",   "image/jpeg" },
+    { "jpeg",  "image/jpeg" },
+    { "png",   "image/png" },
+    { "gif",   "image/gif" },
+    { "svg",   "image/svg+xml" },
+    { "webp",  "image/webp" },
+    { "avif",  "image/avif" },
+    { "ico",   "image/x-icon" },
+    { "bmp",   "image/bmp" },
+    { "mp4",   "video/mp4" },
+    { "webm",  "video/webm" },
+    { "mpeg",  "video/mpeg" },
+    { "mov",   "video/quicktime" },
+    { "mp3",   "audio/mpeg" },
+    { "ogg",   "audio/ogg" },
+    { "wav",   "audio/wav" },
+    { "flac",  "audio/flac" },
+    { "woff",  "font/woff" },
+    { "woff2", "font/woff2" },
+    { "ttf",   "font/ttf" },
+    { "otf",   "font/otf" },
+    { "eot",   "application/vnd.ms-fontobject" },
+    { "wasm",  "application/wasm" },
+    { "pdf",   "application/pdf" },
+    { "zip",   "application/zip" },
+    { "gz",    "application/gzip" },
+    { "tar",   "application/x-tar" },
+    { "php",   "text/html" },  // PHP output is typically HTML
+};
+
+#define MIME_TABLE_SLOTS 256  // Power of two, comfortably above the entry count
+
+static struct {
+    uint64_t key;
+    const char *content_type;
+} mime_table[MIME_TABLE_SLOTS];
+
+// Intern an extension: pack up to 8 lowercased bytes into one integer.
+// Returns 0 for extensions too long to be in the table.
+static uint64_t mime_key(const char *extension) {
+    uint64_t key = 0;
+    int i = 0;
+    for (; extension[i] != '\0'; i++) {
+        if (i == 8) {
+            return 0;
+        }
+        key |= (uint64_t)(unsigned char)tolower((unsigned char)extension[i])
+               << (i * 8);
+    }
+    return key;
+}
+
+static unsigned int mime_slot(uint64_t key) {
+    return (unsigned int)((key * 0x9E3779B97F4A7C15ull) >> 56);
+}
+
+// Spread the compile-time table into the hash table (linear probing)
+static void mime_table_init(void) {
+    for (size_t i = 0; i < sizeof(mime_types) / sizeof(mime_types[0]); i++) {
+        uint64_t key = mime_key(mime_types[i].extension);
+        unsigned int slot = mime_slot(key);
+        while (mime_table[slot].key != 0) {
+            slot = (slot + 1) & (MIME_TABLE_SLOTS - 1);
+        }
+        mime_table[slot].key = key;
+        mime_table[slot].content_type = mime_types[i].content_type;
+    }
+}
+
+// Helper function to determine content type based on file extension
+const char* get_content_type(const char *extension) {
+    uint64_t key = mime_key(extension);
+    if (key != 0) {
+        unsigned int slot = mime_slot(key);
+        while (mime_table[slot].key != 0) {
+            if (mime_table[slot].key == key) {
+                return mime_table[slot].content_type;
+            }
+            slot = (slot + 1) & (MIME_TABLE_SLOTS - 1);
+        }
+    }
+    return "application/octet-stream";
+}
+
+// Set a file descriptor to non-blocking mode
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Vectorized byte search: the parser's inner loop is finding the next
+// delimiter (space, colon, CR), so scan 16 bytes per step with SSE2
+// compare+movemask instead of byte-at-a-time.
+#if defined(__SSE2__)
+#include <emmintrin.h>
+static const char *find_byte(const char *p, const char *end, char c) {
+    __m128i needle = _mm_set1_epi8(c);
+    while (p + 16 <= end) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    while (p < end) {
+        if (*p == c) {
+            return p;
+        }
+        p++;
+    }
+    return NULL;
+}
+#else
+static const char *find_byte(const char *p, const char *end, char c) {
+    return memchr(p, c, end - p);
+}
+#endif
+
+// Case-insensitive substring check over a (non NUL-terminated) header value
+static int header_value_contains(const http_header *header, const char *token) {
+    size_t token_len = strlen(token);
+    if (header->value_len < token_len) {
+        return 0;
+    }
+    for (size_t i = 0; i + token_len <= header->value_len; i++) {
+        if (strncasecmp(header->value + i, token, token_len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Look up a request header by name; returns NULL if absent
+static const http_header *request_find_header(const http_request *req,
+                                              const char *name) {
+    size_t name_len = strlen(name);
+    for (int i = 0; i < req->num_headers; i++) {
+        if (req->headers[i].name_len == name_len &&
+            strncasecmp(req->headers[i].name, name, name_len) == 0) {
+            return &req->headers[i];
+        }
+    }
+    return NULL;
+}
+
+// Check whether the request's Accept-Encoding header lists a coding,
+// honoring token boundaries so "br" does not match inside "abr"
+static int accept_encoding_allows(const http_request *req, const char *coding) {
+    const http_header *accept = request_find_header(req, "Accept-Encoding");
+    if (accept == NULL) {
+        return 0;
+    }
+
+    size_t coding_len = strlen(coding);
+    const char *p = accept->value;
+    const char *end = accept->value + accept->value_len;
+    while (p + coding_len <= end) {
+        if (strncasecmp(p, coding, coding_len) == 0 &&
+            (p == accept->value || p[-1] == ',' || p[-1] == ' ') &&
+            (p + coding_len == end || p[coding_len] == ',' ||
+             p[coding_len] == ' ' || p[coding_len] == ';')) {
+            return 1;
+        }
+        p++;
+    }
+    return 0;
+}
+
+// Parse a complete header block (len includes the terminating blank
+// line): request line plus all headers in one pass, extracting the
+// fields every request needs. Returns 0 on success, -1 if malformed.
+static int parse_http_request(const char *buf, size_t len, http_request *req) {
+    const char *end = buf + len;
+    const char *p = buf;
+
+    memset(req, 0, sizeof(*req));
+    req->content_length = -1;
+
+    // Request line: METHOD SP TARGET SP HTTP/1.x CRLF
+    const char *sp = find_byte(p, end, ' ');
+    if (sp == NULL || (size_t)(sp - p) >= sizeof(req->method) || sp == p) {
+        return -1;
+    }
+    memcpy(req->method, p, sp - p);
+    req->method[sp - p] = '\0';
+    p = sp + 1;
+
+    sp = find_byte(p, end, ' ');
+    if (sp == NULL || (size_t)(sp - p) >= sizeof(req->target) || sp == p) {
+        return -1;
+    }
+    memcpy(req->target, p, sp - p);
+    req->target[sp - p] = '\0';
+    p = sp + 1;
+
+    if (end - p < 8 || memcmp(p, "HTTP/1.", 7) != 0 ||
+        (p[7] != '0' && p[7] != '1')) {
+        return -1;
+    }
+    req->minor_version = p[7] - '0';
+
+    const char *eol = find_byte(p, end, '\r');
+    if (eol == NULL || eol + 1 >= end || eol[1] != '\n') {
+        return -1;
+    }
+    p = eol + 2;
+
+    // Header lines until the blank line
+    while (p < end && *p != '\r') {
+        eol = find_byte(p, end, '\r');
+        if (eol == NULL || eol + 1 >= end || eol[1] != '\n') {
+            return -1;
+        }
+        const char *colon = find_byte(p, eol, ':');
+        if (colon == NULL || colon == p) {
+            return -1;
+        }
+        const char *value = colon + 1;
+        while (value < eol && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        if (req->num_headers < MAX_HEADERS) {
+            http_header *header = &req->headers[req->num_headers++];
+            header->name = p;
+            header->name_len = colon - p;
+            header->value = value;
+            header->value_len = eol - value;
+        }
+        p = eol + 2;
+    }
+
+    // Derived fields. HTTP/1.1 defaults to keep-alive, HTTP/1.0 to
+    // close; an explicit Connection header wins either way.
+    req->keep_alive = req->minor_version >= 1;
+    const http_header *connection_hdr = request_find_header(req, "Connection");
+    if (connection_hdr != NULL) {
+        if (header_value_contains(connection_hdr, "close")) {
+            req->keep_alive = 0;
+        } else if (header_value_contains(connection_hdr, "keep-alive")) {
+            req->keep_alive = 1;
+        }
+    }
+    const http_header *length_hdr = request_find_header(req, "Content-Length");
+    if (length_hdr != NULL) {
+        req->content_length = strtol(length_hdr->value, NULL, 10);
+        if (req->content_length < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Hex nibble values for percent-decoding, stored as value + 1 so a
+// zero entry marks a non-hex byte
+static const unsigned char hex_nibble[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15,
+    ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15,
+    ['F'] = 16,
+};
+
+// Percent-decode a request path in place. The scan for '%' goes through
+// find_byte() — 16 bytes per step under SSE2 — and the literal run up to
+// the next escape moves in one memmove, so the common all-literal path
+// costs a single scan and no per-byte work. The scalar fixup decodes any
+// %XX escape via the nibble table, which covers multi-byte UTF-8
+// sequences as a byte at a time. '+' stays literal: its space alias is a
+// form/query convention, not part of path encoding. Returns -1 on a
+// truncated or non-hex escape and on an encoded NUL, both of which the
+// caller rejects rather than guessing at.
+static int url_decode_path(char *path) {
+    const char *end = path + strlen(path);
+    const char *src = path;
+    char *dst = path;
+
+    while (src < end) {
+        const char *pct = find_byte(src, end, '%');
+        size_t literal = (size_t)((pct != NULL ? pct : end) - src);
+        memmove(dst, src, literal);
+        dst += literal;
+        src += literal;
+        if (src == end) {
+            break;
+        }
+
+        if (end - src < 3) {
+            return -1;  // '%' with fewer than two bytes after it
+        }
+        unsigned char hi = hex_nibble[(unsigned char)src[1]];
+        unsigned char lo = hex_nibble[(unsigned char)src[2]];
+        if (hi == 0 || lo == 0) {
+            return -1;  // Escape digits are not hex
+        }
+        unsigned char decoded = (unsigned char)(((hi - 1) << 4) | (lo - 1));
+        if (decoded == '\0') {
+            return -1;  // An encoded NUL would truncate the path
+        }
+        *dst++ = (char)decoded;
+        src += 3;
+    }
+    *dst = '\0';
+    return 0;
+}
+
+// Normalize dot segments in a decoded request path, in place. Empty and
+// "." segments collapse, ".." pops the previous segment, and a ".."
+// that would climb above the www root rejects the whole path — naive
+// concatenation onto WWW_DIRECTORY was a traversal hole. A trailing
+// slash survives normalization because index probing keys off it.
+// Returns 0 on success, -1 when the path escapes the root.
+static int canonicalize_path(char *path) {
+    if (path[0] != '/') {
+        return -1;
+    }
+
+    size_t in_len = strlen(path);
+    int trailing = path[in_len - 1] == '/' ||
+        (in_len >= 2 && strcmp(path + in_len - 2, "/.") == 0) ||
+        (in_len >= 3 && strcmp(path + in_len - 3, "/..") == 0);
+
+    char out[MAX_PATH_LENGTH];
+    size_t out_len = 0;
+    const char *p = path;
+    while (*p != '\0') {
+        while (*p == '/') {
+            p++;
+        }
+        const char *seg = p;
+        while (*p != '\0' && *p != '/') {
+            p++;
+        }
+        size_t seg_len = (size_t)(p - seg);
+        if (seg_len == 0 || (seg_len == 1 && seg[0] == '.')) {
+            continue;
+        }
+        if (seg_len == 2 && seg[0] == '.' && seg[1] == '.') {
+            if (out_len == 0) {
+                return -1;  // Climbs above the www root
+            }
+            while (out_len > 0 && out[out_len - 1] != '/') {
+                out_len--;
+            }
+            out_len--;  // The segment's slash goes too
+            continue;
+        }
+        if (out_len + 1 + seg_len >= sizeof(out) - 1) {
+            return -1;
+        }
+        out[out_len++] = '/';
+        memcpy(out + out_len, seg, seg_len);
+        out_len += seg_len;
+    }
+
+    if (trailing || out_len == 0) {
+        out[out_len++] = '/';
+    }
+    memcpy(path, out, out_len);
+    path[out_len] = '\0';
+    return 0;
+}
+
+// In-memory file cache. Hot files are mmap'd once and served straight
+// from memory; a hit is revalidated against the filesystem at most every
+// FILE_CACHE_RECHECK_SECONDS, so the steady-state request path does no
+// stat(), open(), or read() at all. The table is direct-mapped: a
+// colliding path simply replaces the previous occupant, which is fine
+// for the small hot set this is built for.
+typedef struct {
+    char path[MAX_PATH_LENGTH];
+    void *data;          // mmap'd file contents
+    size_t size;
+    time_t mtime;        // mtime when cached; a change invalidates the entry
+    time_t last_checked; // Last time we re-stat'ed the file
+    int valid;
+} file_cache_entry;
+
+static file_cache_entry file_cache[FILE_CACHE_SLOTS];
+static pthread_rwlock_t file_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// djb2 over the path, masked to a table slot
+static unsigned int file_cache_slot(const char *path) {
+    unsigned int hash = 5381;
+    while (*path) {
+        hash = hash * 33 + (unsigned char)*path++;
+    }
+    return hash & (FILE_CACHE_SLOTS - 1);
+}
+
+// Release an entry's mapping. Caller holds the write lock.
+static void file_cache_drop(file_cache_entry *entry) {
+    if (entry->valid) {
+        munmap(entry->data, entry->size);
+        entry->valid = 0;
+    }
+}
+
+// Cache a file that was just opened and stat'ed by the slow path
+static void file_cache_insert(const char *path, int fd, const struct stat *st) {
+    if (st->st_size == 0 || st->st_size > FILE_CACHE_MAX_FILE_SIZE) {
+        return;  // Too big (or empty); the sendfile path handles it fine
+    }
+
+    void *data = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return;
+    }
+
+    file_cache_entry *entry = &file_cache[file_cache_slot(path)];
+    pthread_rwlock_wrlock(&file_cache_lock);
+    file_cache_drop(entry);
+    snprintf(entry->path, MAX_PATH_LENGTH, "%s", path);
+    entry->data = data;
+    entry->size = st->st_size;
+    entry->mtime = st->st_mtime;
+    entry->last_checked = time(NULL);
+    entry->valid = 1;
+    pthread_rwlock_unlock(&file_cache_lock);
+}
+
+// ---------------------------------------------------------------------------
+// Stat cache: path → file metadata plus a pooled open descriptor.
+// Resolving one request costs up to four metadata syscalls today
+// (existence probes in handle_client(), then open() + fstat()); on an
+// NFS-backed www tree each is a network round trip. A hit here answers
+// from memory, and for regular files also hands out an already-open
+// descriptor, so the hot path reaches sendfile() with no filesystem
+// traffic at all. Absent paths are cached too — that is what makes the
+// per-request .br/.gz variant probes affordable. Entries revalidate on
+// the same short TTL as the content cache; pooled descriptors beyond
+// the cap are closed oldest-first.
+
+#define STAT_CACHE_SLOTS 512
+#define STAT_CACHE_MAX_FDS 64
+
+typedef struct {
+    char path[MAX_PATH_LENGTH];
+    int valid;
+    int exists;        // 0 marks a path known to be absent
+    int is_dir;
+    int fd;            // Pooled descriptor for regular files, else -1
+    off_t size;
+    time_t mtime;
+    time_t last_checked;
+    time_t last_used;  // For oldest-first descriptor eviction
+} stat_cache_entry;
+
+static stat_cache_entry stat_cache[STAT_CACHE_SLOTS];
+static pthread_rwlock_t stat_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+static int stat_cache_open_fds;
+
+static unsigned int stat_cache_slot(const char *path) {
+    unsigned int hash = 5381;
+    while (*path) {
+        hash = hash * 33 + (unsigned char)*path++;
+    }
+    return hash & (STAT_CACHE_SLOTS - 1);
+}
+
+// Close an entry's pooled descriptor. Caller holds the write lock.
+// Never-used slots are all-zero, so the fd is only meaningful once the
+// entry has been populated.
+static void stat_cache_close_fd(stat_cache_entry *entry) {
+    if (entry->valid && entry->fd != -1) {
+        close(entry->fd);
+        entry->fd = -1;
+        stat_cache_open_fds--;
+    }
+}
+
+// Keep the descriptor pool under its cap by closing the one that went
+// longest without a hit. Caller holds the write lock.
+static void stat_cache_evict_fd(void) {
+    stat_cache_entry *oldest = NULL;
+    for (int i = 0; i < STAT_CACHE_SLOTS; i++) {
+        stat_cache_entry *e = &stat_cache[i];
+        if (e->valid && e->fd != -1 &&
+            (oldest == NULL || e->last_used < oldest->last_used)) {
+            oldest = e;
+        }
+    }
+    if (oldest != NULL) {
+        stat_cache_close_fd(oldest);
+    }
+}
+
+// Record fresh stat results for a path; st == NULL caches the path as
+// absent. For regular files the caller's descriptor is dup'ed into the
+// pool (the caller keeps its own).
+static void stat_cache_store(const char *path, const struct stat *st, int fd) {
+    stat_cache_entry *entry = &stat_cache[stat_cache_slot(path)];
+    pthread_rwlock_wrlock(&stat_cache_lock);
+    stat_cache_close_fd(entry);
+    snprintf(entry->path, MAX_PATH_LENGTH, "%s", path);
+    entry->valid = 1;
+    entry->exists = st != NULL;
+    entry->is_dir = st != NULL && S_ISDIR(st->st_mode);
+    entry->size = st != NULL ? st->st_size : 0;
+    entry->mtime = st != NULL ? st->st_mtime : 0;
+    entry->last_checked = time(NULL);
+    entry->last_used = entry->last_checked;
+    entry->fd = -1;
+    if (fd != -1 && st != NULL && S_ISREG(st->st_mode)) {
+        if (stat_cache_open_fds >= STAT_CACHE_MAX_FDS) {
+            stat_cache_evict_fd();
+        }
+        entry->fd = dup(fd);
+        if (entry->fd != -1) {
+            stat_cache_open_fds++;
+        }
+    }
+    pthread_rwlock_unlock(&stat_cache_lock);
+}
+
+// Look a path up. Returns 1 for a fresh positive hit (st_out is filled
+// in; when fd_out is non-NULL and the entry has a pooled descriptor,
+// *fd_out gets a dup the caller owns, else -1), 0 for a fresh negative
+// hit, and -1 when the caller must go to the filesystem. Descriptors
+// can be dup'ed and handed out safely because every consumer does
+// positional I/O — nothing touches the shared file offset.
+static int stat_cache_lookup(const char *path, struct stat *st_out,
+                             int *fd_out) {
+    stat_cache_entry *entry = &stat_cache[stat_cache_slot(path)];
+    time_t now = time(NULL);
+    int result = -1;
+
+    pthread_rwlock_rdlock(&stat_cache_lock);
+    if (entry->valid && strcmp(entry->path, path) == 0 &&
+        now - entry->last_checked < FILE_CACHE_RECHECK_SECONDS) {
+        if (entry->exists) {
+            memset(st_out, 0, sizeof(*st_out));
+            st_out->st_mode = entry->is_dir ? S_IFDIR : S_IFREG;
+            st_out->st_size = entry->size;
+            st_out->st_mtime = entry->mtime;
+            if (fd_out != NULL) {
+                *fd_out = entry->fd != -1 ? dup(entry->fd) : -1;
+            }
+            entry->last_used = now;  // Racy under the read lock; benign
+            result = 1;
+        } else {
+            result = 0;
+        }
+    }
+    pthread_rwlock_unlock(&stat_cache_lock);
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Route cache: raw request target → resolved dispatch decision. A miss
+// runs percent-decoding, canonicalization, index probing, and extension
+// dispatch and then records where it ended up, so a repeat of the same
+// target jumps straight to the right serve function with its resolved
+// disk path. Entries expire on the usual short TTL because the index
+// probes and PHP existence checks they froze can go stale. Shared
+// across workers under the same direct-mapped rwlock scheme as the
+// other caches.
+
+#define ROUTE_CACHE_SLOTS 512
+
+typedef enum {
+    ROUTE_FILE,       // serve_file() with the resolved disk path
+    ROUTE_PHP,        // serve_php() with the resolved script path
+    ROUTE_NOT_FOUND,  // Resolution already failed; answer 404
+} route_decision;
+
+typedef struct {
+    char target[MAX_PATH_LENGTH];     // Raw, undecoded request target
+    char disk_path[MAX_PATH_LENGTH];
+    route_decision decision;
+    int valid;
+    time_t cached_at;
+} route_cache_entry;
+
+static route_cache_entry route_cache[ROUTE_CACHE_SLOTS];
+static pthread_rwlock_t route_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static unsigned int route_cache_slot(const char *target) {
+    unsigned int hash = 5381;
+    while (*target) {
+        hash = hash * 33 + (unsigned char)*target++;
+    }
+    return hash & (ROUTE_CACHE_SLOTS - 1);
+}
+
+// Copy out a fresh route for the target; returns 1 on a hit
+static int route_cache_lookup(const char *target, route_decision *decision,
+                              char *disk_path) {
+    route_cache_entry *entry = &route_cache[route_cache_slot(target)];
+    int hit = 0;
+
+    pthread_rwlock_rdlock(&route_cache_lock);
+    if (entry->valid && strcmp(entry->target, target) == 0 &&
+        time(NULL) - entry->cached_at < FILE_CACHE_RECHECK_SECONDS) {
+        *decision = entry->decision;
+        memcpy(disk_path, entry->disk_path, MAX_PATH_LENGTH);
+        hit = 1;
+    }
+    pthread_rwlock_unlock(&route_cache_lock);
+    return hit;
+}
+
+static void route_cache_store(const char *target, route_decision decision,
+                              const char *disk_path) {
+    route_cache_entry *entry = &route_cache[route_cache_slot(target)];
+
+    pthread_rwlock_wrlock(&route_cache_lock);
+    snprintf(entry->target, MAX_PATH_LENGTH, "%s", target);
+    snprintf(entry->disk_path, MAX_PATH_LENGTH, "%s",
+             disk_path != NULL ? disk_path : "");
+    entry->decision = decision;
+    entry->cached_at = time(NULL);
+    entry->valid = 1;
+    pthread_rwlock_unlock(&route_cache_lock);
+}
+
+// Header value for the negotiated connection behavior
+static const char *connection_header_value(const connection *conn) {
+    return conn->keep_alive ? "keep-alive" : "close";
+}
+
+// Append raw bytes to a connection's response header buffer
+static int conn_header_append(connection *conn, const char *data, size_t len) {
+    if (conn->header_len + len > HEADER_BUF_SIZE) {
+        return -1;
+    }
+    memcpy(conn->header_buf + conn->header_len, data, len);
+    conn->header_len += len;
+    return 0;
+}
+
+// Format response headers into the connection's header buffer
+static int conn_header_printf(connection *conn, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int written = vsnprintf(conn->header_buf + conn->header_len,
+                            HEADER_BUF_SIZE - conn->header_len, fmt, args);
+    va_end(args);
+
+    if (written < 0 || (size_t)written >= HEADER_BUF_SIZE - conn->header_len) {
+        return -1;
+    }
+    conn->header_len += written;
+    return 0;
+}
+
+// Append bytes to a connection's response body buffer. The buffer comes
+// from the connection's arena while the body fits — the common case for
+// error pages and small cached files, with no malloc on the hot path —
+// and migrates to a doubling heap buffer when a large body (cached files
+// run up to 1 MB) outgrows it.
+static int conn_append(connection *conn, const char *data, size_t len) {
+    // A HEAD response carries every header of the GET it mirrors but no
+    // body; dropping the bytes here suppresses it for every producer
+    if (conn->head_only) {
+        return 0;
+    }
+    if (conn->out_buf == NULL) {
+        size_t avail = conn_arena_avail(conn);
+        if (avail > 0) {
+            conn->out_buf = conn_arena_alloc(conn, avail);
+            conn->out_capacity = avail;
+            conn->out_in_arena = 1;
+        }
+    }
+    if (conn->out_len + len > conn->out_capacity) {
+        size_t new_capacity =
+            conn->out_capacity > 0 ? conn->out_capacity : BUFFER_SIZE;
+        while (new_capacity < conn->out_len + len) {
+            new_capacity *= 2;
+        }
+        if (conn->out_in_arena) {
+            char *heap_buf = malloc(new_capacity);
+            if (heap_buf == NULL) {
+                return -1;
+            }
+            memcpy(heap_buf, conn->out_buf, conn->out_len);
+            conn->out_buf = heap_buf;
+            conn->out_in_arena = 0;
+        } else {
+            char *heap_buf = realloc(conn->out_buf, new_capacity);
+            if (heap_buf == NULL) {
+                return -1;
+            }
+            conn->out_buf = heap_buf;
+        }
+        conn->out_capacity = new_capacity;
+    }
+    memcpy(conn->out_buf + conn->out_len, data, len);
+    conn->out_len += len;
+    return 0;
+}
+
+// Serve GET /metrics: aggregate the per-thread slots into Prometheus
+// text format. This endpoint lives outside the WWW_DIRECTORY lookup.
+static void serve_metrics(connection *conn) {
+    // Unlike the file paths, Content-Length here comes from the built
+    // body, so build it even for HEAD and drop the bytes at the end —
+    // otherwise conn_append suppresses them first and the header says 0
+    int head_only = conn->head_only;
+    conn->head_only = 0;
+
+    uint64_t by_status[METRICS_NUM_STATUS] = {0};
+    uint64_t bytes_sent = 0;
+    uint64_t latency_buckets[METRICS_BUCKETS] = {0};
+    uint64_t latency_sum_us = 0;
+    uint64_t latency_count = 0;
+
+    int slots = metrics_used_slots;
+    if (slots > METRICS_MAX_THREADS) {
+        slots = METRICS_MAX_THREADS;
+    }
+    for (int s = 0; s < slots; s++) {
+        for (int i = 0; i < METRICS_NUM_STATUS; i++) {
+            by_status[i] += metrics_slots[s].by_status[i];
+        }
+        bytes_sent += metrics_slots[s].bytes_sent;
+        for (int i = 0; i < METRICS_BUCKETS; i++) {
+            latency_buckets[i] += metrics_slots[s].latency_buckets[i];
+        }
+        latency_sum_us += metrics_slots[s].latency_sum_us;
+        latency_count += metrics_slots[s].latency_count;
+    }
+
+    char line[256];
+    int len;
+
+    const char *requests_help =
+        "# HELP http_requests_total Requests served, by status code.\n"
+        "# TYPE http_requests_total counter\n";
+    conn_append(conn, requests_help, strlen(requests_help));
+    for (int i = 0; i < METRICS_NUM_STATUS; i++) {
+        len = snprintf(line, sizeof(line),
+                       "http_requests_total{code=\"%d\"} %llu\n",
+                       metrics_status_codes[i],
+                       (unsigned long long)by_status[i]);
+        conn_append(conn, line, len);
+    }
+
+    len = snprintf(line, sizeof(line),
+        "# HELP http_response_bytes_total Bytes written to clients.\n"
+        "# TYPE http_response_bytes_total counter\n"
+        "http_response_bytes_total %llu\n",
+        (unsigned long long)bytes_sent);
+    conn_append(conn, line, len);
+
+    const char *duration_help =
+        "# HELP http_request_duration_seconds Request latency.\n"
+        "# TYPE http_request_duration_seconds histogram\n";
+    conn_append(conn, duration_help, strlen(duration_help));
+    uint64_t cumulative = 0;
+    for (int i = 0; i < METRICS_BUCKETS - 1; i++) {
+        cumulative += latency_buckets[i];
+        len = snprintf(line, sizeof(line),
+                       "http_request_duration_seconds_bucket{le=\"%g\"} %llu\n",
+                       (double)(1ull << i) / 1e6,
+                       (unsigned long long)cumulative);
+        conn_append(conn, line, len);
+    }
+    cumulative += latency_buckets[METRICS_BUCKETS - 1];
+    len = snprintf(line, sizeof(line),
+        "http_request_duration_seconds_bucket{le=\"+Inf\"} %llu\n"
+        "http_request_duration_seconds_sum %g\n"
+        "http_request_duration_seconds_count %llu\n",
+        (unsigned long long)cumulative,
+        (double)latency_sum_us / 1e6,
+        (unsigned long long)latency_count);
+    conn_append(conn, line, len);
+
+    conn->status = 200;
+    conn_header_printf(conn,
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        conn->out_len, connection_header_value(conn));
+
+    conn->head_only = head_only;
+    if (head_only) {
+        conn->out_len = 0;
+    }
+}
+
+// Format a time as an HTTP-date (RFC 7231, always GMT)
+static void http_date(time_t t, char *buf, size_t len) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, len, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+// Derive an entity tag from a file's size and mtime — cheap, and changes
+// whenever the content does for our deploy model
+static void make_etag(size_t size, time_t mtime, char *buf, size_t len) {
+    snprintf(buf, len, "\"%zx-%lx\"", size, (long)mtime);
+}
+
+// Check the request's conditional headers against the file's validators.
+// Returns 1 when the client's copy is current and a 304 is in order.
+// If-None-Match takes precedence over If-Modified-Since, per spec.
+static int conditional_matches(connection *conn, const char *etag,
+                               time_t mtime) {
+    const http_header *if_none_match =
+        request_find_header(&conn->request, "If-None-Match");
+    if (if_none_match != NULL) {
+        return header_value_contains(if_none_match, etag) ||
+               header_value_contains(if_none_match, "*");
+    }
+
+    const http_header *if_modified_since =
+        request_find_header(&conn->request, "If-Modified-Since");
+    if (if_modified_since != NULL) {
+        char date_buf[64];
+        size_t n = if_modified_since->value_len;
+        if (n >= sizeof(date_buf)) {
+            return 0;
+        }
+        memcpy(date_buf, if_modified_since->value, n);
+        date_buf[n] = '\0';
+
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        if (strptime(date_buf, "%a, %d %b %Y %H:%M:%S GMT", &tm) != NULL &&
+            mtime <= timegm(&tm)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Queue a 304 Not Modified response: validators only, zero body I/O
+static void send_not_modified(connection *conn, const char *etag,
+                              time_t mtime) {
+    char last_modified[64];
+    http_date(mtime, last_modified, sizeof(last_modified));
+    conn->status = 304;
+    conn_header_printf(conn,
+        "HTTP/1.1 304 Not Modified\r\n"
+        "ETag: %s\r\n"
+        "Last-Modified: %s\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        etag, last_modified, connection_header_value(conn));
+}
+
+// Parse a single byte range against the entity size. Returns -1 when
+// there is no Range header or it cannot be parsed (unsupported
+// multipart, malformed spec) — RFC 7233 says to ignore such a header
+// and serve the full entity — 0 with *start/*length filled for a valid
+// range, and 1 for a well-formed but unsatisfiable one (416).
+static int parse_range(connection *conn, off_t file_size,
+                       off_t *start, off_t *length) {
+    const http_header *range_hdr = request_find_header(&conn->request, "Range");
+    if (range_hdr == NULL) {
+        return -1;
+    }
+
+    char spec[64];
+    if (range_hdr->value_len >= sizeof(spec)) {
+        return -1;
+    }
+    memcpy(spec, range_hdr->value, range_hdr->value_len);
+    spec[range_hdr->value_len] = '\0';
+
+    if (strncmp(spec, "bytes=", 6) != 0 || strchr(spec, ',') != NULL) {
+        return -1;  // Only single "bytes=" ranges are supported
+    }
+    const char *p = spec + 6;
+
+    if (*p == '-') {
+        // Suffix range: the last N bytes
+        char *parse_end;
+        long long suffix = strtoll(p + 1, &parse_end, 10);
+        if (parse_end == p + 1 || *parse_end != '\0' || suffix <= 0) {
+            return -1;
+        }
+        if (suffix > file_size) {
+            suffix = file_size;
+        }
+        *start = file_size - suffix;
+        *length = suffix;
+        return 0;
+    }
+
+    char *parse_end;
+    long long first = strtoll(p, &parse_end, 10);
+    if (parse_end == p || *parse_end != '-' || first < 0) {
+        return -1;
+    }
+    long long last = file_size - 1;
+    if (parse_end[1] != '\0') {
+        const char *last_str = parse_end + 1;
+        last = strtoll(last_str, &parse_end, 10);
+        if (parse_end == last_str || *parse_end != '\0' || last < first) {
+            return -1;
+        }
+    }
+    if (first >= file_size) {
+        return 1;
+    }
+    if (last >= file_size) {
+        last = file_size - 1;
+    }
+    *start = first;
+    *length = last - first + 1;
+    return 0;
+}
+
+// Queue a 416 Range Not Satisfiable response
+static void send_range_not_satisfiable(connection *conn, off_t file_size) {
+    conn->status = 416;
+    conn_header_printf(conn,
+        "HTTP/1.1 416 Range Not Satisfiable\r\n"
+        "Content-Range: bytes */%ld\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        (long)file_size, connection_header_value(conn));
+}
+
+// Try to serve a request straight from the file cache. Returns 1 on a
+// hit (the response is fully queued), 0 when the caller must fall back
+// to the filesystem. content_encoding is non-NULL when the cached file
+// is a precompressed variant.
+static int file_cache_serve(connection *conn, const char *file_path,
+                            const char *content_type,
+                            const char *content_encoding, int vary) {
+    file_cache_entry *entry = &file_cache[file_cache_slot(file_path)];
+    time_t now = time(NULL);
+
+    pthread_rwlock_rdlock(&file_cache_lock);
+
+    if (!entry->valid || strcmp(entry->path, file_path) != 0) {
+        pthread_rwlock_unlock(&file_cache_lock);
+        return 0;
+    }
+
+    if (now - entry->last_checked >= FILE_CACHE_RECHECK_SECONDS) {
+        // Revalidation is due; retake the lock for writing
+        pthread_rwlock_unlock(&file_cache_lock);
+        pthread_rwlock_wrlock(&file_cache_lock);
+
+        // The entry may have been replaced while we were unlocked
+        if (!entry->valid || strcmp(entry->path, file_path) != 0) {
+            pthread_rwlock_unlock(&file_cache_lock);
+            return 0;
+        }
+
+        if (now - entry->last_checked >= FILE_CACHE_RECHECK_SECONDS) {
+            struct stat st;
+            if (stat(file_path, &st) == -1 || st.st_mtime != entry->mtime ||
+                (size_t)st.st_size != entry->size) {
+                // File changed or vanished; drop the entry and let the
+                // slow path reload it
+                file_cache_drop(entry);
+                pthread_rwlock_unlock(&file_cache_lock);
+                return 0;
+            }
+            entry->last_checked = now;
+        }
+    }
+
+    log_debug("Serving from cache: %s", file_path);
+
+    char etag[64];
+    char last_modified[64];
+    make_etag(entry->size, entry->mtime, etag, sizeof(etag));
+    http_date(entry->mtime, last_modified, sizeof(last_modified));
+
+    // A matching conditional request needs no body at all
+    if (conditional_matches(conn, etag, entry->mtime)) {
+        send_not_modified(conn, etag, entry->mtime);
+        pthread_rwlock_unlock(&file_cache_lock);
+        return 1;
+    }
+
+    // Byte ranges are served straight out of the mapping
+    off_t range_start = 0;
+    off_t range_length = (off_t)entry->size;
+    int range = parse_range(conn, (off_t)entry->size, &range_start,
+                            &range_length);
+    if (range == 1) {
+        send_range_not_satisfiable(conn, (off_t)entry->size);
+        pthread_rwlock_unlock(&file_cache_lock);
+        return 1;
+    }
+
+    if (range == 0) {
+        conn->status = 206;
+        conn_header_printf(conn,
+            "HTTP/1.1 206 Partial Content\r\n"
+            "Content-Range: bytes %ld-%ld/%zu\r\n",
+            (long)range_start, (long)(range_start + range_length - 1),
+            entry->size);
+    } else {
+        conn->status = 200;
+        conn_header_append(conn, "HTTP/1.1 200 OK\r\n", 17);
+    }
+    conn_header_printf(conn,
+        "Content-Type: %s\r\n"
+        "Content-Length: %ld\r\n"
+        "Accept-Ranges: bytes\r\n"
+        "ETag: %s\r\n"
+        "Last-Modified: %s\r\n"
+        "Connection: %s\r\n",
+        content_type, (long)range_length, etag, last_modified,
+        connection_header_value(conn));
+    if (content_encoding != NULL) {
+        conn_header_printf(conn,
+            "Content-Encoding: %s\r\n"
+            "Vary: Accept-Encoding\r\n",
+            content_encoding);
+    } else if (vary) {
+        // The identity response of an asset with a compressed sibling
+        // is negotiated too; without Vary a shared cache would serve
+        // whichever body it saw first to every client
+        conn_header_append(conn, "Vary: Accept-Encoding\r\n", 23);
+    }
+    conn_header_append(conn, "\r\n", 2);
+    conn_append(conn, (const char *)entry->data + range_start, range_length);
+
+    pthread_rwlock_unlock(&file_cache_lock);
+    return 1;
+}
+
+// Queue a 404 Not Found response
+void send_not_found(connection *conn) {
+    const char *body =
+        "<html><body>"
+        "<h1>404 Not Found</h1>"
+        "<p>The requested resource could not be found on this server.</p>"
+        "</body></html>";
+
+    conn->status = 404;
+    conn_header_printf(conn,
+        "HTTP/1.1 404 Not Found\r\n"
+        "Content-Type: text/html\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        strlen(body), connection_header_value(conn));
+    conn_append(conn, body, strlen(body));
+}
+
+// Queue a 405 Method Not Allowed response
+static void send_method_not_allowed(connection *conn) {
+    const char *body =
+        "<html><body>"
+        "<h1>405 Method Not Allowed</h1>"
+        "<p>The request method is not supported by this server.</p>"
+        "</body></html>";
+
+    conn->status = 405;
+    conn_header_printf(conn,
+        "HTTP/1.1 405 Method Not Allowed\r\n"
+        "Allow: GET, HEAD, OPTIONS\r\n"
+        "Content-Type: text/html\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        strlen(body), connection_header_value(conn));
+    conn_append(conn, body, strlen(body));
+}
+
+// Queue a 204 No Content response advertising the supported methods
+static void send_options(connection *conn) {
+    conn->status = 204;
+    conn_header_printf(conn,
+        "HTTP/1.1 204 No Content\r\n"
+        "Allow: GET, HEAD, OPTIONS\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        connection_header_value(conn));
+}
+
+// Queue a 400 Bad Request response
+void send_bad_request(connection *conn) {
+    const char *body =
+        "<html><body>"
+        "<h1>400 Bad Request</h1>"
+        "<p>The server could not understand the request.</p>"
+        "</body></html>";
+
+    conn->status = 400;
+    conn_header_printf(conn,
+        "HTTP/1.1 400 Bad Request\r\n"
+        "Content-Type: text/html\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        strlen(body));
+    conn_append(conn, body, strlen(body));
+}
+
+// Queue a 500 Internal Server Error response
+void send_server_error(connection *conn) {
+    const char *body =
+        "<html><body>"
+        "<h1>500 Internal Server Error</h1>"
+        "<p>The server encountered an error while processing your request.</p>"
+        "</body></html>";
+
+    conn->status = 500;
+    conn_header_printf(conn,
+        "HTTP/1.1 500 Internal Server Error\r\n"
+        "Content-Type: text/html\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        strlen(body), connection_header_value(conn));
+    conn_append(conn, body, strlen(body));
+}
+
+// TTL output cache for PHP responses. Many dynamic endpoints produce
+// identical output for minutes at a time; a hit serves the stored body
+// in microseconds instead of a full PHP execution. Same design as the
+// static file cache — direct-mapped, djb2-hashed, rwlock-guarded — but
+// separate storage: file cache entries are mmap'd disk pages validated
+// by mtime, these are heap buffers validated by wall-clock expiry.
+// Scripts opt out per path by emitting Cache-Control: no-store,
+// no-cache, or private.
+#define PHP_CACHE_SLOTS 64
+
+static int php_cache_ttl = 60;  // Seconds; --php-cache-ttl N, 0 disables
+
+typedef struct {
+    char path[MAX_PATH_LENGTH];
+    char status_line[64];  // e.g. "200 OK"
+    char *headers;         // Script-provided headers, CRLF-separated lines
+    size_t headers_len;
+    char *body;
+    size_t body_len;
+    time_t expires;
+    int valid;
+} php_cache_entry;
+
+static php_cache_entry php_cache[PHP_CACHE_SLOTS];
+static pthread_rwlock_t php_cache_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static size_t php_cache_slot(const char *path) {
+    size_t hash = 5381;
+    for (const char *p = path; *p != '\0'; p++) {
+        hash = hash * 33 + (unsigned char)*p;
+    }
+    return hash % PHP_CACHE_SLOTS;
+}
+
+// Case-insensitive substring search over a non-terminated buffer;
+// returns the offset of the first match or -1
+static ssize_t mem_find_ci(const char *hay, size_t hay_len,
+                           const char *needle) {
+    size_t needle_len = strlen(needle);
+    if (hay_len < needle_len) {
+        return -1;
+    }
+    for (size_t i = 0; i + needle_len <= hay_len; i++) {
+        if (strncasecmp(hay + i, needle, needle_len) == 0) {
+            return (ssize_t)i;
+        }
+    }
+    return -1;
+}
+
+// Did the script's headers opt this response out of the cache?
+static int php_headers_forbid_cache(const char *headers, size_t len) {
+    // A Set-Cookie response is per-visitor by definition: replaying it
+    // would hand the first visitor's session cookie to everyone else
+    if (mem_find_ci(headers, len, "Set-Cookie:") != -1) {
+        return 1;
+    }
+    ssize_t off = mem_find_ci(headers, len, "Cache-Control:");
+    if (off == -1) {
+        return 0;
+    }
+    const char *line = headers + off;
+    size_t line_len = len - (size_t)off;
+    const char *line_end = memchr(line, '\r', line_len);
+    if (line_end != NULL) {
+        line_len = (size_t)(line_end - line);
+    }
+    return mem_find_ci(line, line_len, "no-store") != -1 ||
+           mem_find_ci(line, line_len, "no-cache") != -1 ||
+           mem_find_ci(line, line_len, "private") != -1;
+}
+
+// Store one complete PHP response. headers may be NULL when the script
+// provided none (the CLI fallback); the body is copied.
+static void php_cache_insert(const char *path, const char *status_line,
+                             const char *headers, size_t headers_len,
+                             const char *body, size_t body_len) {
+    if (php_cache_ttl <= 0 || strlen(path) >= MAX_PATH_LENGTH ||
+        body_len > FILE_CACHE_MAX_FILE_SIZE) {
+        return;
+    }
+
+    char *body_copy = malloc(body_len > 0 ? body_len : 1);
+    if (body_copy == NULL) {
+        return;
+    }
+    memcpy(body_copy, body, body_len);
+
+    char *headers_copy = NULL;
+    if (headers != NULL && headers_len > 0) {
+        headers_copy = malloc(headers_len);
+        if (headers_copy == NULL) {
+            free(body_copy);
+            return;
+        }
+        memcpy(headers_copy, headers, headers_len);
+    }
+
+    php_cache_entry *entry = &php_cache[php_cache_slot(path)];
+    pthread_rwlock_wrlock(&php_cache_lock);
+    free(entry->headers);
+    free(entry->body);
+    snprintf(entry->path, sizeof(entry->path), "%s", path);
+    snprintf(entry->status_line, sizeof(entry->status_line), "%s",
+             status_line);
+    entry->headers = headers_copy;
+    entry->headers_len = headers_len;
+    entry->body = body_copy;
+    entry->body_len = body_len;
+    entry->expires = time(NULL) + php_cache_ttl;
+    entry->valid = 1;
+    pthread_rwlock_unlock(&php_cache_lock);
+}
+
+// Serve a PHP request straight from the output cache. Returns 1 on a
+// fresh hit with the response fully queued, 0 otherwise.
+static int php_cache_serve(connection *conn, const char *path) {
+    if (php_cache_ttl <= 0) {
+        return 0;
+    }
+
+    php_cache_entry *entry = &php_cache[php_cache_slot(path)];
+    pthread_rwlock_rdlock(&php_cache_lock);
+    if (!entry->valid || strcmp(entry->path, path) != 0 ||
+        time(NULL) >= entry->expires) {
+        pthread_rwlock_unlock(&php_cache_lock);
+        return 0;
+    }
+
+    log_debug("Serving PHP from cache: %s", path);
+    conn->status = atoi(entry->status_line);
+    conn_header_printf(conn,
+        "HTTP/1.1 %s\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: %s\r\n",
+        entry->status_line, entry->body_len, connection_header_value(conn));
+    if (entry->headers != NULL) {
+        conn_header_append(conn, entry->headers, entry->headers_len);
+    } else {
+        conn_header_append(conn, "Content-Type: text/html\r\n", 25);
+    }
+    conn_header_append(conn, "\r\n", 2);
+    conn_append(conn, entry->body, entry->body_len);
+    pthread_rwlock_unlock(&php_cache_lock);
+    return 1;
+}
+
+// Idle php-fpm connections available for reuse
+static int fcgi_pool[FCGI_POOL_SIZE] = {[0 ... FCGI_POOL_SIZE - 1] = -1};
+static pthread_mutex_t fcgi_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Open a fresh connection to the php-fpm unix socket
+static int fcgi_connect(void) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", FCGI_SOCKET_PATH);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    struct timeval timeout = { .tv_sec = FCGI_TIMEOUT_SECONDS };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+// Take an idle pooled connection, or dial a new one
+static int fcgi_acquire(void) {
+    pthread_mutex_lock(&fcgi_pool_lock);
+    for (int i = 0; i < FCGI_POOL_SIZE; i++) {
+        if (fcgi_pool[i] != -1) {
+            int fd = fcgi_pool[i];
+            fcgi_pool[i] = -1;
+            pthread_mutex_unlock(&fcgi_pool_lock);
+            return fd;
+        }
+    }
+    pthread_mutex_unlock(&fcgi_pool_lock);
+    return fcgi_connect();
+}
+
+// Return a connection to the pool, or close it if it went bad or the
+// pool is full
+static void fcgi_release(int fd, int reusable) {
+    if (reusable) {
+        pthread_mutex_lock(&fcgi_pool_lock);
+        for (int i = 0; i < FCGI_POOL_SIZE; i++) {
+            if (fcgi_pool[i] == -1) {
+                fcgi_pool[i] = fd;
+                pthread_mutex_unlock(&fcgi_pool_lock);
+                return;
+            }
+        }
+        pthread_mutex_unlock(&fcgi_pool_lock);
+    }
+    close(fd);
+}
+
+// Write an 8-byte FastCGI record header
+static void fcgi_put_header(unsigned char *p, int type, size_t content_len) {
+    p[0] = FCGI_VERSION_1;
+    p[1] = (unsigned char)type;
+    p[2] = 0;  // Request id 1: one request in flight per connection
+    p[3] = 1;
+    p[4] = (unsigned char)(content_len >> 8);
+    p[5] = (unsigned char)(content_len & 0xff);
+    p[6] = 0;  // No padding
+    p[7] = 0;
+}
+
+// Encode one name/value pair in FastCGI params format; returns bytes written
+static size_t fcgi_put_param(unsigned char *p, const char *name, const char *value) {
+    size_t name_len = strlen(name);
+    size_t value_len = strlen(value);
+    size_t off = 0;
+
+    p[off++] = (unsigned char)name_len;  // Names here are always short
+    if (value_len < 128) {
+        p[off++] = (unsigned char)value_len;
+    } else {
+        p[off++] = (unsigned char)((value_len >> 24) | 0x80);
+        p[off++] = (unsigned char)(value_len >> 16);
+        p[off++] = (unsigned char)(value_len >> 8);
+        p[off++] = (unsigned char)value_len;
+    }
+    memcpy(p + off, name, name_len);
+    off += name_len;
+    memcpy(p + off, value, value_len);
+    off += value_len;
+    return off;
+}
+
+// Write exactly len bytes to a blocking socket
+static int write_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Read exactly len bytes from a blocking socket
+static int read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Run one script through php-fpm. On success, *out holds the raw CGI
+// output (headers + body, malloc'd) and 0 is returned; -1 means the
+// caller should fall back to the CLI path.
+static int fcgi_request(const char *script_path, char **out, size_t *out_len) {
+    int fd = fcgi_acquire();
+    if (fd == -1) {
+        return -1;
+    }
+
+    // Request preamble: begin-request, params, end-of-params, end-of-stdin
+    unsigned char request[BUFFER_SIZE];
+    size_t off = 0;
+
+    fcgi_put_header(request + off, FCGI_BEGIN_REQUEST, 8);
+    off += 8;
+    request[off++] = 0;                // Role: responder
+    request[off++] = FCGI_RESPONDER;
+    request[off++] = FCGI_KEEP_CONN;   // Keep the connection for reuse
+    memset(request + off, 0, 5);
+    off += 5;
+
+    unsigned char params[BUFFER_SIZE];
+    size_t params_len = 0;
+    params_len += fcgi_put_param(params + params_len, "SCRIPT_FILENAME", script_path);
+    params_len += fcgi_put_param(params + params_len, "REQUEST_METHOD", "GET");
+    params_len += fcgi_put_param(params + params_len, "QUERY_STRING", "");
+    params_len += fcgi_put_param(params + params_len, "SERVER_PROTOCOL", "HTTP/1.1");
+    params_len += fcgi_put_param(params + params_len, "GATEWAY_INTERFACE", "CGI/1.1");
+
+    fcgi_put_header(request + off, FCGI_PARAMS, params_len);
+    off += 8;
+    memcpy(request + off, params, params_len);
+    off += params_len;
+    fcgi_put_header(request + off, FCGI_PARAMS, 0);
+    off += 8;
+    fcgi_put_header(request + off, FCGI_STDIN, 0);
+    off += 8;
+
+    if (write_full(fd, request, off) == -1) {
+        fcgi_release(fd, 0);
+        return -1;
+    }
+
+    // Collect STDOUT records until the application ends the request
+    char *output = NULL;
+    size_t output_len = 0;
+    int ok = -1;
+
+    while (1) {
+        unsigned char header[8];
+        if (read_full(fd, header, 8) == -1) {
+            break;
+        }
+        size_t content_len = ((size_t)header[4] << 8) | header[5];
+        size_t padding_len = header[6];
+
+        // The read covers content plus padding, so the bound must too:
+        // content_len alone maxes out the 16-bit field at exactly the
+        // buffer size, and padding can add up to 255 bytes beyond it
+        char content[65536 + 255];
+        if (content_len + padding_len > sizeof(content) ||
+            read_full(fd, content, content_len + padding_len) == -1) {
+            break;
+        }
+
+        if (header[1] == FCGI_STDOUT && content_len > 0) {
+            char *grown = realloc(output, output_len + content_len);
+            if (grown == NULL) {
+                break;
+            }
+            memcpy(grown + output_len, content, content_len);
+            output = grown;
+            output_len += content_len;
+        } else if (header[1] == FCGI_STDERR && content_len > 0) {
+            fprintf(stderr, "php-fpm: %.*s", (int)content_len, content);
+        } else if (header[1] == FCGI_END_REQUEST) {
+            ok = 0;
+            break;
+        }
+    }
+
+    if (ok == 0) {
+        fcgi_release(fd, 1);
+        *out = output;
+        *out_len = output_len;
+    } else {
+        fcgi_release(fd, 0);
+        free(output);
+    }
+    return ok;
+}
+
+// Serve a PHP script through the php-fpm pool. Returns 1 if the response
+// was queued, 0 when the caller should fall back to fork/exec.
+static int serve_php_fastcgi(connection *conn, const char *file_path) {
+    char script_abs[PATH_MAX];
+    if (realpath(file_path, script_abs) == NULL) {
+        return 0;
+    }
+
+    char *output = NULL;
+    size_t output_len = 0;
+    if (fcgi_request(script_abs, &output, &output_len) == -1) {
+        return 0;
+    }
+
+    // Split the CGI output into its header block and body
+    const char *body = output;
+    size_t body_len = output_len;
+    size_t php_headers_len = 0;
+    char *headers_end = output ? memmem(output, output_len, "\r\n\r\n", 4) : NULL;
+    if (headers_end != NULL) {
+        php_headers_len = headers_end - output;
+        body = headers_end + 4;
+        body_len = output_len - php_headers_len - 4;
+    }
+
+    // PHP may override the status line via a Status: header
+    const char *status = "200 OK";
+    char status_buf[64];
+    if (php_headers_len > 0) {
+        char *status_header = memmem(output, php_headers_len, "Status:", 7);
+        if (status_header != NULL) {
+            status_header += 7;
+            while (*status_header == ' ') {
+                status_header++;
+            }
+            size_t n = strcspn(status_header, "\r\n");
+            if (n >= sizeof(status_buf)) {
+                n = sizeof(status_buf) - 1;
+            }
+            memcpy(status_buf, status_header, n);
+            status_buf[n] = '\0';
+            status = status_buf;
+        }
+    }
+
+    conn->status = atoi(status);
+
+    // Knowing the full body length up front lets FastCGI responses use
+    // keep-alive, unlike the streaming CLI fallback
+    conn_header_printf(conn,
+        "HTTP/1.1 %s\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: %s\r\n",
+        status, body_len, connection_header_value(conn));
+
+    // Pass the script's own headers (Content-Type, cookies, ...) through,
+    // dropping the internal Status: line. The same filtered block is
+    // collected for the output cache so a hit can replay it verbatim.
+    char *cache_headers = NULL;
+    size_t cache_headers_len = 0;
+    if (php_headers_len > 0) {
+        cache_headers = malloc(php_headers_len + 2);
+        const char *line = output;
+        const char *block_end = output + php_headers_len;
+        while (line < block_end) {
+            const char *line_end = memmem(line, block_end - line, "\r\n", 2);
+            size_t line_len = line_end ? (size_t)(line_end - line)
+                                       : (size_t)(block_end - line);
+            if (strncasecmp(line, "Status:", 7) != 0) {
+                conn_header_append(conn, line, line_len);
+                conn_header_append(conn, "\r\n", 2);
+                if (cache_headers != NULL) {
+                    memcpy(cache_headers + cache_headers_len, line, line_len);
+                    cache_headers_len += line_len;
+                    memcpy(cache_headers + cache_headers_len, "\r\n", 2);
+                    cache_headers_len += 2;
+                }
+            }
+            line += line_len + 2;
+        }
+    } else {
+        conn_header_append(conn, "Content-Type: text/html\r\n", 25);
+    }
+    conn_header_append(conn, "\r\n", 2);
+    conn_append(conn, body, body_len);
+
+    if (!php_headers_forbid_cache(output, php_headers_len)) {
+        php_cache_insert(file_path, status, cache_headers, cache_headers_len,
+                         body, body_len);
+    }
+    free(cache_headers);
+    free(output);
+    return 1;
+}
+
+// Push the already-built response headers straight to the socket,
+// waiting out short stalls. Used when a body will bypass the response
+// buffers (splice streaming). Returns -1 if the client went away.
+// Socket I/O shims. Plain connections — and TLS connections where kTLS
+// offload engaged — use the raw descriptor; the userspace-TLS fallback
+// routes through the SSL object instead. Both directions normalize to
+// the read()/write() convention the flush loops expect: -1 with EAGAIN
+// for "try again", 0 for EOF.
+static ssize_t conn_recv_bytes(connection *conn, void *buf, size_t len) {
+    if (conn->ssl == NULL || !conn->tls_userspace) {
+        return read(conn->fd, buf, len);
+    }
+    int n = SSL_read(conn->ssl, buf, (int)len);
+    if (n > 0) {
+        return n;
+    }
+    int err = SSL_get_error(conn->ssl, n);
+    if (err == SSL_ERROR_ZERO_RETURN) {
+        return 0;  // close_notify: the peer is done sending
+    }
+    errno = (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+                ? EAGAIN : EIO;
+    return -1;
+}
+
+static ssize_t conn_send_bytes(connection *conn, const void *buf, size_t len) {
+    if (conn->ssl == NULL || !conn->tls_userspace) {
+        return write(conn->fd, buf, len);
+    }
+    if (len > (1u << 30)) {
+        len = 1u << 30;  // SSL_write takes an int
+    }
+    int n = SSL_write(conn->ssl, buf, (int)len);
+    if (n > 0) {
+        return n;
+    }
+    int err = SSL_get_error(conn->ssl, n);
+    errno = (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+                ? EAGAIN : EIO;
+    return -1;
+}
+
+static int conn_write_headers_now(connection *conn) {
+    while (conn->header_sent < conn->header_len) {
+        ssize_t written = conn_send_bytes(conn,
+                                conn->header_buf + conn->header_sent,
+                                conn->header_len - conn->header_sent);
+        if (written > 0) {
+            conn->header_sent += written;
+            conn->resp_bytes += (uint64_t)written;
+        } else if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = { .fd = conn->fd, .events = POLLOUT };
+            if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int conn_flush_blocking(connection *conn);
+
+// Fallback for kernels where splice() to a socket is unsupported: copy
+// the pipe into the response buffer and let conn_flush() drain it. The
+// same flush threshold as the chunked loop keeps the buffered window
+// bounded no matter how large the body grows.
+static void php_stream_copy(connection *conn, int pipe_out) {
+    char buffer[BUFFER_SIZE];
+    while (1) {
+        ssize_t bytes_read = read(pipe_out, buffer, sizeof(buffer));
+        if (bytes_read > 0) {
+            conn_append(conn, buffer, bytes_read);
+            if (conn->out_len - conn->out_sent >= PHP_STREAM_FLUSH_BYTES) {
+                if (conn_flush_blocking(conn) == -1) {
+                    return;  // Client gone; drop the rest of the output
+                }
+                conn->out_len = 0;
+                conn->out_sent = 0;
+            }
+        } else if (bytes_read == -1 &&
+                   (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = { .fd = pipe_out, .events = POLLIN };
+            if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+                return;
+            }
+        } else {
+            return;  // EOF or error
+        }
+    }
+}
+
+static int conn_flush(connection *conn);
+
+// Push everything queued so far onto the wire, waiting on POLLOUT the
+// way conn_write_headers_now() does. Returns -1 when the connection
+// dies. Used by the streaming paths to bound their buffering.
+static int conn_flush_blocking(connection *conn) {
+    while (1) {
+        int flushed = conn_flush(conn);
+        if (flushed == 1) {
+            return 0;
+        }
+        if (flushed == -1) {
+            return -1;
+        }
+        struct pollfd pfd = { .fd = conn->fd, .events = POLLOUT };
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+// Append one chunk of a Transfer-Encoding: chunked body: hex size line,
+// the data, and the trailing CRLF. Zero-length pieces are skipped — an
+// empty chunk would terminate the body early.
+static void conn_append_chunk(connection *conn, const char *data, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    char size_line[16];
+    int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+    conn_append(conn, size_line, (size_t)n);
+    conn_append(conn, data, len);
+    conn_append(conn, "\r\n", 2);
+}
+
+// Chunked-framing variant of the copy loop: each pipe read becomes one
+// chunk, so the body is self-delimiting without a Content-Length and
+// the connection survives for the next request. The buffered window is
+// bounded: once a flush threshold accumulates, it goes to the wire
+// before the next pipe read, so a body of any size streams through a
+// fixed-size buffer instead of accumulating wholesale.
+static void php_stream_copy_chunked(connection *conn, int pipe_out) {
+    char buffer[BUFFER_SIZE];
+    while (1) {
+        ssize_t bytes_read = read(pipe_out, buffer, sizeof(buffer));
+        if (bytes_read > 0) {
+            conn_append_chunk(conn, buffer, (size_t)bytes_read);
+            if (conn->out_len - conn->out_sent >= PHP_STREAM_FLUSH_BYTES) {
+                if (conn_flush_blocking(conn) == -1) {
+                    return;  // Client gone; drop the rest of the output
+                }
+                // Everything queued is on the wire; reuse the buffer
+                conn->out_len = 0;
+                conn->out_sent = 0;
+            }
+        } else if (bytes_read == -1 &&
+                   (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = { .fd = pipe_out, .events = POLLIN };
+            if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+                break;
+            }
+        } else {
+            break;  // EOF or error: the body ends here
+        }
+    }
+    conn_append(conn, "0\r\n\r\n", 5);  // Terminal chunk
+}
+
+// Stream the script's output from the pipe to the socket with splice():
+// the kernel moves the pages directly between the two, with no copy
+// through a userspace buffer
+static void php_stream_output(connection *conn, int pipe_out) {
+    if (conn->tls_userspace) {
+        // splice() would bypass the TLS record layer; buffer the body
+        // and let conn_flush() encrypt it on the way out
+        php_stream_copy(conn, pipe_out);
+        return;
+    }
+    while (1) {
+        ssize_t moved = splice(pipe_out, NULL, conn->fd, NULL, 1 << 16,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (moved > 0) {
+            conn->resp_bytes += (uint64_t)moved;
+        } else if (moved == 0) {
+            return;  // Script closed its stdout: body complete
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // Empty pipe or full socket? Probe the pipe to tell, then
+            // sleep on whichever side is the bottleneck — a slow script
+            // never busy-spins this thread against a writable socket
+            struct pollfd pfd = { .fd = pipe_out, .events = POLLIN };
+            if (poll(&pfd, 1, 0) > 0) {
+                pfd.fd = conn->fd;
+                pfd.events = POLLOUT;
+            }
+            if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+                return;
+            }
+        } else if (errno == EINVAL || errno == ENOSYS) {
+            php_stream_copy(conn, pipe_out);
+            return;
+        } else {
+            return;  // Client went away; drop the rest of the output
+        }
+    }
+}
+
+static int conn_flush(connection *conn);
+
+// Read the script's whole output into a growing buffer, up to the cache
+// size limit. Returns the captured length; *complete is 0 when output
+// was still flowing at the limit (the caller streams the rest).
+static size_t php_capture_output(int pipe_out, char **buf_out,
+                                 int *complete) {
+    size_t capacity = BUFFER_SIZE;
+    size_t len = 0;
+    char *buf = malloc(capacity);
+    *complete = 1;
+    if (buf == NULL) {
+        *buf_out = NULL;
+        return 0;
+    }
+
+    while (1) {
+        if (len == capacity) {
+            if (capacity >= FILE_CACHE_MAX_FILE_SIZE) {
+                *complete = 0;
+                break;
+            }
+            capacity *= 2;
+            char *grown = realloc(buf, capacity);
+            if (grown == NULL) {
+                *complete = 0;
+                break;
+            }
+            buf = grown;
+        }
+        ssize_t bytes_read = read(pipe_out, buf + len, capacity - len);
+        if (bytes_read > 0) {
+            len += (size_t)bytes_read;
+        } else if (bytes_read == -1 &&
+                   (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = { .fd = pipe_out, .events = POLLIN };
+            if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+                break;
+            }
+        } else {
+            break;  // EOF or error: the body ends here
+        }
+    }
+
+    *buf_out = buf;
+    return len;
+}
+
+// Execute a PHP script and queue its output for the client
+void serve_php(connection *conn, const char *file_path) {
+    // A fresh cached response skips the PHP execution entirely
+    if (php_cache_serve(conn, file_path)) {
+        return;
+    }
+
+    log_debug("Executing PHP script: %s", file_path);
+
+    // Preferred path: persistent php-fpm workers over FastCGI
+    if (serve_php_fastcgi(conn, file_path)) {
+        return;
+    }
+
+    // Create a pipe to capture the output of the PHP process
+    int pipe_fd[2];
+    if (pipe(pipe_fd) == -1) {
+        perror("Failed to create pipe");
+        send_server_error(conn);
+        return;
+    }
+
+    // Fork a child process to execute the PHP script
+    pid_t pid = fork();
+    if (pid == -1) {
+        // Fork failed
+        perror("Failed to fork process");
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+        send_server_error(conn);
+        return;
+    }
+
+    if (pid == 0) {
+        // This is the child process
+        // Redirect stdout to the pipe
+        close(pipe_fd[0]);  // Close read end
+        dup2(pipe_fd[1], STDOUT_FILENO);
+        close(pipe_fd[1]);
+
+        // Execute the PHP script
+        execl(PHP_CLI, PHP_CLI, file_path, NULL);
+
+        // If execl returns, it failed
+        perror("Failed to execute PHP");
+        exit(EXIT_FAILURE);
+    } else {
+        // This is the parent process
+        close(pipe_fd[1]);  // Close write end
+        set_nonblocking(pipe_fd[0]);
+
+        conn->status = 200;
+
+        if (php_cache_ttl > 0) {
+            // Capture the body so repeat hits skip the execution: one
+            // buffered run per TTL beats zero-copy streaming for
+            // endpoints that repeat. Knowing the length up front also
+            // lets the connection stay open.
+            char *capture;
+            int complete;
+            size_t capture_len =
+                php_capture_output(pipe_fd[0], &capture, &complete);
+            if (complete) {
+                conn_header_printf(conn,
+                    "HTTP/1.1 200 OK\r\n"
+                    "Content-Type: text/html\r\n"
+                    "Content-Length: %zu\r\n"
+                    "Connection: %s\r\n"
+                    "\r\n",
+                    capture_len, connection_header_value(conn));
+                conn_append(conn, capture, capture_len);
+                php_cache_insert(file_path, "200 OK", NULL, 0, capture,
+                                 capture_len);
+            } else if (conn->keep_alive && conn->request.minor_version >= 1) {
+                // Output outgrew the cache limit, so no length is known
+                // up front; chunked framing delimits the body and the
+                // connection survives for the next request
+                const char *headers =
+                    "HTTP/1.1 200 OK\r\n"
+                    "Content-Type: text/html\r\n"
+                    "Transfer-Encoding: chunked\r\n"
+                    "Connection: keep-alive\r\n"
+                    "\r\n";
+                conn_header_append(conn, headers, strlen(headers));
+                conn_append_chunk(conn, capture, capture_len);
+                if (conn_flush(conn) != -1 && !conn->head_only) {
+                    php_stream_copy_chunked(conn, pipe_fd[0]);
+                }
+            } else {
+                // HTTP/1.0 without keep-alive cannot take chunked;
+                // stream the rest and close to delimit the body
+                conn->keep_alive = 0;
+                const char *headers =
+                    "HTTP/1.1 200 OK\r\n"
+                    "Content-Type: text/html\r\n"
+                    "Connection: close\r\n"
+                    "\r\n";
+                conn_header_append(conn, headers, strlen(headers));
+                conn_append(conn, capture, capture_len);
+                if (conn_flush(conn) != -1 && !conn->head_only) {
+                    php_stream_copy(conn, pipe_fd[0]);
+                }
+            }
+            free(capture);
+        } else if (conn->keep_alive && conn->request.minor_version >= 1) {
+            // Cache disabled: no Content-Length exists, so frame the
+            // body chunked to keep the connection open. Push the headers
+            // out first so the client sees the response start while the
+            // script is still producing output.
+            const char *headers =
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/html\r\n"
+                "Transfer-Encoding: chunked\r\n"
+                "Connection: keep-alive\r\n"
+                "\r\n";
+            conn_header_append(conn, headers, strlen(headers));
+            if (conn_flush(conn) != -1 && !conn->head_only) {
+                php_stream_copy_chunked(conn, pipe_fd[0]);
+            }
+        } else {
+            // An HTTP/1.0 client without keep-alive gets the original
+            // close-delimited stream — which also keeps the zero-copy
+            // splice() path for clients that asked for it
+            conn->keep_alive = 0;
+            const char *headers =
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/html\r\n"
+                "Connection: close\r\n"
+                "\r\n";
+            conn_header_append(conn, headers, strlen(headers));
+
+            // Send the headers now, then splice() the script's output
+            // from the pipe straight into the socket
+            if (conn_write_headers_now(conn) == 0 && !conn->head_only) {
+                php_stream_output(conn, pipe_fd[0]);
+            }
+        }
+
+        close(pipe_fd[0]);
+
+        // Wait for the child process to finish
+        int status;
+        waitpid(pid, &status, 0);
+
+        if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+            log_printf("PHP script exited with status %d", WEXITSTATUS(status));
+        }
+    }
+}
+
+// Queue a static file: headers go into out_buf, the body is streamed from
+// the open descriptor as the socket accepts it
+// Serve one concrete file (possibly a precompressed variant) from cache
+// or disk. Returns 1 if a response was queued, 0 if the file is absent.
+static int serve_file_variant(connection *conn, const char *disk_path,
+                              const char *content_type,
+                              const char *content_encoding, int vary) {
+    // A cache hit serves straight from memory
+    if (file_cache_serve(conn, disk_path, content_type, content_encoding,
+                         vary)) {
+        return 1;
+    }
+
+    // Resolve metadata — and ideally an open descriptor — from the stat
+    // cache before touching the filesystem
+    struct stat file_stat;
+    int file_fd = -1;
+    int cached = stat_cache_lookup(disk_path, &file_stat, &file_fd);
+    if (cached == 0) {
+        return 0;  // Known absent; skip the open() probe entirely
+    }
+    if (cached == 1 && !S_ISREG(file_stat.st_mode)) {
+        return 0;  // Known directory; not a servable file
+    }
+    if (cached == -1 || file_fd == -1) {
+        file_fd = open(disk_path, O_RDONLY);
+        if (file_fd == -1) {
+            stat_cache_store(disk_path, NULL, -1);
+            return 0;
+        }
+        if (fstat(file_fd, &file_stat) == -1) {
+            perror("Failed to get file stats");
+            close(file_fd);
+            send_server_error(conn);
+            return 1;
+        }
+        if (!S_ISREG(file_stat.st_mode)) {
+            // open() happily opens a directory, but sendfile() can never
+            // deliver the body the headers would promise — treat it as
+            // absent (and remember that, so the lookup above short-cuts)
+            stat_cache_store(disk_path, &file_stat, -1);
+            close(file_fd);
+            return 0;
+        }
+        stat_cache_store(disk_path, &file_stat, file_fd);
+    }
+
+    log_debug("Serving file: %s", disk_path);
+
+    // Remember the file for future requests
+    file_cache_insert(disk_path, file_fd, &file_stat);
+
+    char etag[64];
+    char last_modified[64];
+    make_etag(file_stat.st_size, file_stat.st_mtime, etag, sizeof(etag));
+    http_date(file_stat.st_mtime, last_modified, sizeof(last_modified));
+
+    // The fstat() validators were already in hand; a matching
+    // conditional request skips all body I/O
+    if (conditional_matches(conn, etag, file_stat.st_mtime)) {
+        close(file_fd);
+        send_not_modified(conn, etag, file_stat.st_mtime);
+        return 1;
+    }
+
+    // A byte range seeks within the already-open descriptor; sendfile()
+    // then streams just the requested window
+    off_t range_start = 0;
+    off_t range_length = file_stat.st_size;
+    int range = parse_range(conn, file_stat.st_size, &range_start,
+                            &range_length);
+    if (range == 1) {
+        close(file_fd);
+        send_range_not_satisfiable(conn, file_stat.st_size);
+        return 1;
+    }
+    if (range == 0) {
+        conn->status = 206;
+        conn_header_printf(conn,
+            "HTTP/1.1 206 Partial Content\r\n"
+            "Content-Range: bytes %ld-%ld/%ld\r\n",
+            (long)range_start, (long)(range_start + range_length - 1),
+            (long)file_stat.st_size);
+    } else {
+        conn->status = 200;
+        conn_header_append(conn, "HTTP/1.1 200 OK\r\n", 17);
+    }
+
+    // Queue HTTP headers
+    conn_header_printf(conn,
+        "Content-Type: %s\r\n"
+        "Content-Length: %ld\r\n"
+        "Accept-Ranges: bytes\r\n"
+        "ETag: %s\r\n"
+        "Last-Modified: %s\r\n"
+        "Connection: %s\r\n",
+        content_type, (long)range_length, etag, last_modified,
+        connection_header_value(conn));
+    if (content_encoding != NULL) {
+        conn_header_printf(conn,
+            "Content-Encoding: %s\r\n"
+            "Vary: Accept-Encoding\r\n",
+            content_encoding);
+    } else if (vary) {
+        // Identity for an asset that also has a compressed sibling:
+        // still a negotiated representation, so still Vary
+        conn_header_append(conn, "Vary: Accept-Encoding\r\n", 23);
+    }
+    conn_header_append(conn, "\r\n", 2);
+
+    // HEAD takes all of the headers above and none of the body
+    if (conn->head_only) {
+        close(file_fd);
+        return 1;
+    }
+
+    // Hand the descriptor to the connection; conn_flush() streams the
+    // body from the range start via positional I/O
+    conn->file_fd = file_fd;
+    conn->file_offset = range_start;
+    conn->file_remaining = range_length;
+
+    // Files beyond the cache limit stream through an adaptive window
+    // with explicit page-cache advice instead of one giant sendfile()
+    if (file_stat.st_size > FILE_CACHE_MAX_FILE_SIZE) {
+        conn->stream_mode = 1;
+        conn->stream_chunk = STREAM_CHUNK_MIN;
+        conn->stream_drop_mark = range_start;
+    }
+    return 1;
+}
+
+// Precompressed variants in preference order: brotli, then gzip
+static const struct {
+    const char *suffix;
+    const char *coding;
+} content_codings[] = {
+    { ".br", "br" },
+    { ".gz", "gzip" },
+};
+
+void serve_file(connection *conn, const char *file_path) {
+    const char *content_type = get_content_type(get_file_extension(file_path));
+
+    // Content-encoding negotiation: serve a pre-built compressed sibling
+    // (e.g. app.js.gz for app.js) when the client accepts its coding. The
+    // variant keeps the original Content-Type; only the transfer bytes
+    // differ. A sibling existing at all makes the representation
+    // negotiated, so even the identity response must carry Vary.
+    int vary = 0;
+    for (size_t i = 0;
+         i < sizeof(content_codings) / sizeof(content_codings[0]); i++) {
+        char encoded_path[MAX_PATH_LENGTH];
+        int len = snprintf(encoded_path, MAX_PATH_LENGTH, "%s%s",
+                           file_path, content_codings[i].suffix);
+        if (len < 0 || len >= MAX_PATH_LENGTH) {
+            continue;
+        }
+        if (!file_exists(encoded_path)) {
+            continue;
+        }
+        vary = 1;
+        if (accept_encoding_allows(&conn->request,
+                                   content_codings[i].coding) &&
+            serve_file_variant(conn, encoded_path, content_type,
+                               content_codings[i].coding, 1)) {
+            return;
+        }
+    }
+
+    // Identity fallback
+    if (!serve_file_variant(conn, file_path, content_type, NULL, vary)) {
+        send_not_found(conn);
+    }
+}
+
+// Dispatch a fully-received request on a connection
+void handle_client(connection *conn) {
+    // Parse only the current request: pipelined bytes behind it belong to
+    // the next one and must not influence this response
+    char saved = conn->in_buf[conn->request_len];
+    conn->in_buf[conn->request_len] = '\0';
+
+    // The access line is emitted when the response finishes; here just
+    // note the request line for debugging
+    log_debug("Received request: %s", conn->in_buf);
+
+    // The event loop already parsed the request as it arrived
+    conn->head_only = 0;
+    if (conn->bad_request) {
+        conn->keep_alive = 0;
+        send_bad_request(conn);
+        conn->in_buf[conn->request_len] = saved;
+        conn->state = CONN_WRITING;
+        return;
+    }
+
+    http_request *req = &conn->request;
+    conn->keep_alive = req->keep_alive;
+
+    // Method gate: HEAD shares the full GET path with body emission
+    // suppressed (the health-check case: headers cost a stat, not a
+    // transfer), OPTIONS answers from the method table alone, and
+    // anything else is refused up front
+    conn->head_only = strcmp(req->method, "HEAD") == 0;
+    if (strcmp(req->method, "OPTIONS") == 0) {
+        send_options(conn);
+        conn->in_buf[conn->request_len] = saved;
+        conn->state = CONN_WRITING;
+        return;
+    }
+    if (!conn->head_only && strcmp(req->method, "GET") != 0) {
+        send_method_not_allowed(conn);
+        conn->in_buf[conn->request_len] = saved;
+        conn->state = CONN_WRITING;
+        return;
+    }
+
+    // A cached route skips decoding, canonicalization, index probing,
+    // and extension dispatch for a repeated target
+    route_decision decision;
+    char file_path[MAX_PATH_LENGTH];
+    if (route_cache_lookup(req->target, &decision, file_path)) {
+        switch (decision) {
+        case ROUTE_FILE:
+            serve_file(conn, file_path);
+            break;
+        case ROUTE_PHP:
+            serve_php(conn, file_path);
+            break;
+        case ROUTE_NOT_FOUND:
+            send_not_found(conn);
+            break;
+        }
+        conn->in_buf[conn->request_len] = saved;
+        conn->state = CONN_WRITING;
+        return;
+    }
+
+    // Decode the request target into a usable path; a malformed escape
+    // is the client's error, not a missing file
+    char path_buf[MAX_PATH_LENGTH];
+    snprintf(path_buf, MAX_PATH_LENGTH, "%s", req->target);
+    if (url_decode_path(path_buf) == -1) {
+        send_bad_request(conn);
+        conn->in_buf[conn->request_len] = saved;
+        conn->state = CONN_WRITING;
+        return;
+    }
+    if (path_buf[0] == '\0') {
+        snprintf(path_buf, MAX_PATH_LENGTH, "/");
+    }
+
+    // Resolve dot segments before the path goes anywhere near the
+    // filesystem; a path that escapes the www root is refused
+    if (canonicalize_path(path_buf) == -1) {
+        route_cache_store(req->target, ROUTE_NOT_FOUND, NULL);
+        send_not_found(conn);
+        conn->in_buf[conn->request_len] = saved;
+        conn->state = CONN_WRITING;
+        return;
+    }
+    char *request_path = path_buf;
+    log_debug("Requested path: %s", request_path);
+
+    // The metrics endpoint lives outside the www tree
+    if (strcmp(request_path, "/metrics") == 0) {
+        serve_metrics(conn);
+        conn->in_buf[conn->request_len] = saved;
+        conn->state = CONN_WRITING;
+        return;
+    }
+
+    // Construct the file path
+    snprintf(file_path, MAX_PATH_LENGTH, "%s%s", WWW_DIRECTORY, request_path);
+
+    // If the path ends with a slash, try to serve index.html or index.php
+    if (request_path[strlen(request_path) - 1] == '/') {
+        char index_html_path[MAX_PATH_LENGTH];
+        char index_php_path[MAX_PATH_LENGTH];
+
+        // file_path already ends with the slash; appending without one
+        // keeps cache keys identical to what a startup preload stores
+        snprintf(index_html_path, MAX_PATH_LENGTH, "%sindex.html", file_path);
+        snprintf(index_php_path, MAX_PATH_LENGTH, "%sindex.php", file_path);
+
+        if (file_exists(index_html_path)) {
+            route_cache_store(req->target, ROUTE_FILE, index_html_path);
+            serve_file(conn, index_html_path);
+        } else if (file_exists(index_php_path)) {
+            route_cache_store(req->target, ROUTE_PHP, index_php_path);
+            serve_php(conn, index_php_path);
+        } else {
+            route_cache_store(req->target, ROUTE_NOT_FOUND, NULL);
+            send_not_found(conn);
+        }
+    } else {
+        // Check if it's a PHP file
+        const char *extension = get_file_extension(file_path);
+        if (strcasecmp(extension, "php") == 0) {
+            if (file_exists(file_path)) {
+                route_cache_store(req->target, ROUTE_PHP, file_path);
+                serve_php(conn, file_path);
+            } else {
+                route_cache_store(req->target, ROUTE_NOT_FOUND, NULL);
+                send_not_found(conn);
+            }
+        } else {
+            // serve_file() probes the cache first and 404s if the file
+            // is absent, so no up-front stat is needed here
+            route_cache_store(req->target, ROUTE_FILE, file_path);
+            serve_file(conn, file_path);
+        }
+    }
+
+    conn->in_buf[conn->request_len] = saved;
+    conn->state = CONN_WRITING;
+}
+
+// Hand a finished connection back to its owning reactor
+static void complete_request(connection *conn) {
+    reactor *r = conn->owner;
+
+    pthread_mutex_lock(&r->completion_lock);
+    conn->next_done = r->completion_head;
+    r->completion_head = conn;
+    pthread_mutex_unlock(&r->completion_lock);
+
+    uint64_t one = 1;
+    if (write(r->completion_event_fd, &one, sizeof(one)) == -1) {
+        perror("Failed to signal completion");
+    }
+}
+
+// Pop the newest connection from a worker's own queue (LIFO keeps the
+// request's buffers warm in that core's cache)
+static connection *worker_take_own(worker *w) {
+    connection *conn = NULL;
+    pthread_mutex_lock(&w->lock);
+    if (w->tail > w->head) {
+        conn = w->queue[--w->tail % WORKER_QUEUE_CAPACITY];
+    }
+    pthread_mutex_unlock(&w->lock);
+    return conn;
+}
+
+// Steal the oldest connection from some other worker's queue
+static connection *worker_steal(int self_index) {
+    for (int i = 1; i < num_workers; i++) {
+        worker *victim = &workers[(self_index + i) % num_workers];
+        connection *conn = NULL;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->tail > victim->head) {
+            conn = victim->queue[victim->head++ % WORKER_QUEUE_CAPACITY];
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (conn != NULL) {
+            return conn;
+        }
+    }
+    return NULL;
+}
+
+// Advance a TLS handshake on the worker pool, keeping the comparatively
+// expensive asymmetric crypto off the reactor thread. Runs under the
+// same dispatch/completion machinery as requests.
+static void tls_handshake_step(connection *conn) {
+    int ret = SSL_do_handshake(conn->ssl);
+    if (ret == 1) {
+        conn->tls_established = 1;
+        // kTLS engaged when OpenSSL pushed the session keys into the
+        // socket, leaving the raw-fd paths (writev, sendfile) intact;
+        // otherwise I/O detours through SSL_read/SSL_write
+        conn->tls_userspace = !(BIO_get_ktls_send(SSL_get_wbio(conn->ssl)) &&
+                                BIO_get_ktls_recv(SSL_get_rbio(conn->ssl)));
+        return;
+    }
+    int err = SSL_get_error(conn->ssl, ret);
+    if (err == SSL_ERROR_WANT_READ) {
+        conn->tls_want_write = 0;
+    } else if (err == SSL_ERROR_WANT_WRITE) {
+        conn->tls_want_write = 1;
+    } else {
+        conn->defunct = 1;  // Bad ClientHello, protocol mismatch, ...
+    }
+}
+
+// Worker main loop: drain our own queue, steal when it runs dry, and
+// sleep briefly when there is nothing anywhere
+static void *worker_main(void *arg) {
+    int self_index = (int)(intptr_t)arg;
+    worker *self = &workers[self_index];
+
+    while (1) {
+        connection *conn = worker_take_own(self);
+        if (conn == NULL) {
+            conn = worker_steal(self_index);
+        }
+
+        if (conn == NULL) {
+            // Nothing anywhere: wait for a push, but wake periodically so
+            // we re-check other queues for stealable work
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += 50 * 1000 * 1000;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_mutex_lock(&self->lock);
+            if (self->tail == self->head) {
+                pthread_cond_timedwait(&self->has_work, &self->lock, &deadline);
+            }
+            pthread_mutex_unlock(&self->lock);
+            continue;
+        }
+
+        if (conn->state == CONN_TLS_HANDSHAKE) {
+            tls_handshake_step(conn);
+        } else {
+            handle_client(conn);
+        }
+        complete_request(conn);
+    }
+
+    return NULL;
+}
+
+// Queue a ready request on the next worker (round-robin). Returns -1 if
+// that worker's queue is full, in which case the caller handles it inline.
+static int dispatch_to_worker(connection *conn) {
+    worker *w = &workers[next_worker++ % num_workers];
+
+    pthread_mutex_lock(&w->lock);
+    if (w->tail - w->head >= WORKER_QUEUE_CAPACITY) {
+        pthread_mutex_unlock(&w->lock);
+        return -1;
+    }
+    w->queue[w->tail++ % WORKER_QUEUE_CAPACITY] = conn;
+    pthread_cond_signal(&w->has_work);
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+// Size the pool to the machine and start the worker threads
+static void start_workers(void) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    num_workers = ncpu > 0 ? (int)ncpu : 1;
+
+    workers = calloc(num_workers, sizeof(worker));
+    if (workers == NULL) {
+        perror("Failed to allocate worker pool");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        pthread_mutex_init(&workers[i].lock, NULL);
+        pthread_cond_init(&workers[i].has_work, NULL);
+        if (pthread_create(&workers[i].thread, NULL, worker_main,
+                           (void *)(intptr_t)i) != 0) {
+            perror("Failed to start worker thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("Started %d worker threads\n", num_workers);
+}
+
+static void close_connection(connection *conn);
+
+// Remove a connection from its reactor's timer wheel
+static void timer_cancel(connection *conn) {
+    if (!conn->timer_armed) {
+        return;
+    }
+    reactor *r = conn->owner;
+    if (conn->timer_prev != NULL) {
+        conn->timer_prev->timer_next = conn->timer_next;
+    } else {
+        r->timer_wheel[conn->timer_slot] = conn->timer_next;
+    }
+    if (conn->timer_next != NULL) {
+        conn->timer_next->timer_prev = conn->timer_prev;
+    }
+    conn->timer_armed = 0;
+}
+
+// Arm (or move) a connection's deadline: unlink, then push onto the
+// bucket its deadline second hashes to. O(1) either way.
+static void timer_set(connection *conn, int seconds) {
+    reactor *r = conn->owner;
+    timer_cancel(conn);
+
+    conn->deadline = time(NULL) + seconds;
+    conn->timer_slot = (int)(conn->deadline % TIMER_WHEEL_SLOTS);
+    conn->timer_prev = NULL;
+    conn->timer_next = r->timer_wheel[conn->timer_slot];
+    if (conn->timer_next != NULL) {
+        conn->timer_next->timer_prev = conn;
+    }
+    r->timer_wheel[conn->timer_slot] = conn;
+    conn->timer_armed = 1;
+}
+
+// Sweep the cursor up to the present, reaping every expired connection
+// in the buckets it passes. Costs O(expired), never a full scan.
+static void timer_tick(reactor *r) {
+    time_t now = time(NULL);
+    while (r->timer_cursor < now) {
+        r->timer_cursor++;
+        connection *conn =
+            r->timer_wheel[r->timer_cursor % TIMER_WHEEL_SLOTS];
+        while (conn != NULL) {
+            connection *next = conn->timer_next;
+            if (conn->deadline <= r->timer_cursor) {
+                timer_cancel(conn);
+                log_debug("Connection from %s timed out", conn->remote_addr);
+                if (conn->in_worker) {
+                    // A worker still owns it — possibly parked in one of
+                    // the streaming paths' unbounded poll/splice waits on
+                    // this socket. Shutting the socket down makes that
+                    // wait error out immediately; the completion path
+                    // then reaps the connection.
+                    conn->defunct = 1;
+                    shutdown(conn->fd, SHUT_RDWR);
+                } else {
+                    close_connection(conn);
+                }
+            }
+            conn = next;
+        }
+    }
+}
+
+// Tear down a connection and release its resources
+static void close_connection(connection *conn) {
+    timer_cancel(conn);
+    if (conn->read_armed || conn->write_armed) {
+        // An in-flight io_uring operation still holds a reference to the
+        // socket, so close() alone would neither release it nor stop the
+        // completion from landing on freed memory. Shut the socket down
+        // instead: the operation completes with EOF or an error, and its
+        // handler calls back here to finish the teardown.
+        shutdown(conn->fd, SHUT_RDWR);
+        return;
+    }
+    epoll_ctl(conn->owner->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    if (conn->ssl != NULL) {
+        if (conn->tls_established) {
+            SSL_shutdown(conn->ssl);  // Best-effort close_notify
+        }
+        SSL_free(conn->ssl);
+    }
+    close(conn->fd);
+    if (conn->file_fd != -1) {
+        close(conn->file_fd);
+    }
+    if (!conn->out_in_arena) {
+        free(conn->out_buf);
+    }
+    conn_slab_free(conn);
+    __atomic_sub_fetch(&active_connections, 1, __ATOMIC_RELAXED);
+}
+
+// Page-cache stewardship for a large streamed body: pull the next
+// window in ahead of the send position, and drop what has already gone
+// out so a multi-GB download passes through the page cache instead of
+// accumulating in it and evicting the hot small-file working set. The
+// advice is per-file, so concurrent streams of the same file may re-read
+// a dropped page — a cheap miss against an unbounded cache footprint.
+static void conn_stream_advise(connection *conn) {
+    // Ask for twice the current window so the disk stays ahead of the
+    // socket while the next chunk is on the wire
+    off_t ahead = (off_t)conn->stream_chunk * 2;
+    if (ahead > conn->file_remaining) {
+        ahead = conn->file_remaining;
+    }
+    posix_fadvise(conn->file_fd, conn->file_offset, ahead,
+                  POSIX_FADV_WILLNEED);
+
+    // Drop sent pages in aligned batches, a full window behind the send
+    // position so a retransmit window never lands on a dropped page
+    off_t drop_to =
+        (conn->file_offset - (off_t)STREAM_CHUNK_MAX) & ~(off_t)4095;
+    if (drop_to > conn->stream_drop_mark) {
+        posix_fadvise(conn->file_fd, conn->stream_drop_mark,
+                      drop_to - conn->stream_drop_mark, POSIX_FADV_DONTNEED);
+        conn->stream_drop_mark = drop_to;
+    }
+}
+
+// Fallback body copy loop for filesystems where sendfile() is not
+// available. Same return convention as conn_flush().
+static int conn_flush_file_copy(connection *conn) {
+    while (conn->file_remaining > 0) {
+        char buffer[BUFFER_SIZE];
+        if (conn->stream_mode) {
+            conn_stream_advise(conn);
+        }
+        size_t chunk = conn->file_remaining < BUFFER_SIZE
+                           ? (size_t)conn->file_remaining : BUFFER_SIZE;
+        ssize_t bytes_read = pread(conn->file_fd, buffer, chunk,
+                                   conn->file_offset);
+        if (bytes_read <= 0) {
+            return -1;
+        }
+
+        ssize_t off = 0;
+        while (off < bytes_read) {
+            ssize_t written = conn_send_bytes(conn, buffer + off,
+                                              bytes_read - off);
+            if (written > 0) {
+                off += written;
+                conn->resp_bytes += (uint64_t)written;
+            } else if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                // Only what actually reached the socket counts as sent
+                conn->file_offset += off;
+                conn->file_remaining -= off;
+                return 0;
+            } else {
+                return -1;
+            }
+        }
+        conn->file_offset += bytes_read;
+        conn->file_remaining -= bytes_read;
+    }
+
+    return 1;
+}
+
+// Cork or uncork the socket so headers and a sendfile'd body leave in
+// full segments instead of a small header packet followed by the body
+static void conn_set_cork(connection *conn, int on) {
+    if (conn->corked != on) {
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+        conn->corked = on;
+    }
+}
+
+// Drain as much of the queued response as the socket will take.
+// Returns 1 when the response is fully sent, 0 if the socket would block
+// (caller waits for EPOLLOUT), and -1 on error.
+static int conn_flush(connection *conn) {
+    // When a file body follows the headers, cork so they coalesce into
+    // full segments across the write/sendfile boundary
+    if (conn->file_fd != -1 && conn->file_remaining > 0) {
+        conn_set_cork(conn, 1);
+    }
+
+    // Headers and in-memory body go out together in one writev()
+    while (conn->header_sent < conn->header_len ||
+           conn->out_sent < conn->out_len) {
+        struct iovec iov[2];
+        int iovcnt = 0;
+        size_t header_left = conn->header_len - conn->header_sent;
+        if (header_left > 0) {
+            iov[iovcnt].iov_base = conn->header_buf + conn->header_sent;
+            iov[iovcnt].iov_len = header_left;
+            iovcnt++;
+        }
+        if (conn->out_sent < conn->out_len) {
+            iov[iovcnt].iov_base = conn->out_buf + conn->out_sent;
+            iov[iovcnt].iov_len = conn->out_len - conn->out_sent;
+            iovcnt++;
+        }
+
+        ssize_t written;
+        if (conn->tls_userspace) {
+            // No scatter/gather through the TLS record layer; send the
+            // first segment and come back around for the rest
+            written = conn_send_bytes(conn, iov[0].iov_base, iov[0].iov_len);
+        } else {
+            written = writev(conn->fd, iov, iovcnt);
+        }
+        if (written > 0) {
+            conn->resp_bytes += (uint64_t)written;
+            if ((size_t)written <= header_left) {
+                conn->header_sent += written;
+            } else {
+                conn->header_sent = conn->header_len;
+                conn->out_sent += (size_t)written - header_left;
+            }
+        } else if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        } else {
+            return -1;
+        }
+    }
+
+    // Then any file body behind it: zero-copy via sendfile(), which moves
+    // pages from the page cache straight to the socket without the
+    // read()/write() round trip through a userspace buffer
+    if (conn->tls_userspace && conn->file_fd != -1 &&
+        conn->file_remaining > 0) {
+        // Without kTLS, sendfile() would bypass the record layer; the
+        // copy loop routes the body through conn_send_bytes() instead
+        int done = conn_flush_file_copy(conn);
+        if (done == 1) {
+            conn_set_cork(conn, 0);
+        }
+        return done;
+    }
+    while (conn->file_fd != -1 && conn->file_remaining > 0) {
+        size_t chunk = (size_t)conn->file_remaining;
+        if (conn->stream_mode) {
+            conn_stream_advise(conn);
+            if (chunk > conn->stream_chunk) {
+                chunk = conn->stream_chunk;
+            }
+        }
+        ssize_t sent = sendfile(conn->fd, conn->file_fd, &conn->file_offset,
+                                chunk);
+        if (sent > 0) {
+            conn->file_remaining -= sent;
+            conn->resp_bytes += (uint64_t)sent;
+            // The socket took the whole window without blocking: the
+            // client is draining faster than we are sending, so widen it
+            if (conn->stream_mode && (size_t)sent == chunk &&
+                conn->stream_chunk < STREAM_CHUNK_MAX) {
+                conn->stream_chunk *= 2;
+            }
+        } else if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Socket backed up: narrow the window so the readahead and
+            // drop-behind cadence tracks the client's real drain rate
+            if (conn->stream_mode && conn->stream_chunk > STREAM_CHUNK_MIN) {
+                conn->stream_chunk /= 2;
+            }
+            return 0;
+        } else if (sent == -1 && (errno == EINVAL || errno == ENOSYS)) {
+            // Filesystem doesn't support sendfile(); fall back to copying
+            return conn_flush_file_copy(conn);
+        } else {
+            return -1;
+        }
+    }
+
+    conn_set_cork(conn, 0);  // Response complete: push out the tail segment
+    return 1;
+}
+
+static void conn_start_write(connection *conn);
+static void conn_finish_response(connection *conn);
+
+// If the input buffer holds a complete request, parse it, mark its
+// extent, and hand it to the worker pool. Returns 1 if a request was
+// dispatched. The terminator scan resumes from scan_offset, so a
+// request trickling in over many reads is never rescanned from the top.
+static int conn_try_dispatch(connection *conn) {
+    if (conn->in_len < 4) {
+        return 0;
+    }
+
+    const char *limit = conn->in_buf + conn->in_len - 3;
+    const char *p = conn->in_buf + conn->scan_offset;
+    const char *headers_end = NULL;
+    while (p < limit && (p = find_byte(p, limit, '\r')) != NULL) {
+        if (p[1] == '\n' && p[2] == '\r' && p[3] == '\n') {
+            headers_end = p;
+            break;
+        }
+        p++;
+    }
+    if (headers_end == NULL) {
+        conn->scan_offset = conn->in_len - 3;
+        return 0;
+    }
+
+    size_t header_len = (headers_end - conn->in_buf) + 4;
+    conn->bad_request =
+        parse_http_request(conn->in_buf, header_len, &conn->request) < 0;
+
+    // A request body (Content-Length) belongs to this request too
+    size_t body_len = 0;
+    if (!conn->bad_request && conn->request.content_length > 0) {
+        body_len = (size_t)conn->request.content_length;
+        if (header_len + body_len > BUFFER_SIZE - 1) {
+            conn->bad_request = 1;  // Body can never fit the buffer
+            body_len = 0;
+        } else if (conn->in_len < header_len + body_len) {
+            return 0;  // Wait for the rest of the body
+        }
+    }
+
+    conn->request_len = header_len + body_len;
+    conn->request_start_us = monotonic_us();
+    // The read deadline is met; the response now has its own
+    timer_set(conn, WRITE_TIMEOUT_SECONDS);
+    conn->state = CONN_PROCESSING;
+    conn->in_worker = 1;
+    if (dispatch_to_worker(conn) == -1) {
+        // Pool is saturated; process on the event loop rather than drop
+        // the request
+        conn->in_worker = 0;
+        handle_client(conn);
+        conn_start_write(conn);
+    }
+    return 1;
+}
+
+// Begin (or finish) sending a built response: flush what the socket will
+// take now, and arm EPOLLOUT if it backs up
+static void conn_start_write(connection *conn) {
+    int flushed = conn_flush(conn);
+    if (flushed == 0) {
+        // Socket is full: wait for write readiness
+        if (use_uring) {
+            uring_queue_pollout(conn);
+        } else {
+            struct epoll_event event;
+            event.events = EPOLLOUT | EPOLLET;
+            event.data.ptr = conn;
+            epoll_ctl(conn->owner->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+        }
+    } else if (flushed == 1) {
+        conn_finish_response(conn);
+    } else {
+        close_connection(conn);
+    }
+}
+
+// A response has been fully sent. Close, or reset the connection for the
+// next request when it is persistent — which may already be sitting in
+// the input buffer if the client pipelined.
+static void conn_finish_response(connection *conn) {
+    // The last byte is on the wire: fold this request into the counters
+    uint64_t latency_us = monotonic_us() - conn->request_start_us;
+    metrics_record(conn->status, conn->resp_bytes, latency_us);
+    log_access(conn, latency_us);
+    conn->resp_bytes = 0;
+
+    if (!conn->keep_alive) {
+        close_connection(conn);
+        return;
+    }
+
+    // Release the response; resetting the arena cursor frees every
+    // request-scoped allocation in one shot
+    conn->header_len = 0;
+    conn->header_sent = 0;
+    if (!conn->out_in_arena) {
+        free(conn->out_buf);
+    }
+    conn->out_buf = NULL;
+    conn->out_len = 0;
+    conn->out_sent = 0;
+    conn->out_capacity = 0;
+    conn->out_in_arena = 0;
+    conn->arena_used = 0;
+    if (conn->file_fd != -1) {
+        close(conn->file_fd);
+        conn->file_fd = -1;
+    }
+    conn->file_offset = 0;
+    conn->file_remaining = 0;
+    conn->stream_mode = 0;
+    conn->stream_chunk = 0;
+    conn->stream_drop_mark = 0;
+
+    // Drop the consumed request, keeping any pipelined bytes behind it
+    memmove(conn->in_buf, conn->in_buf + conn->request_len,
+            conn->in_len - conn->request_len);
+    conn->in_len -= conn->request_len;
+    conn->in_buf[conn->in_len] = '\0';
+    conn->request_len = 0;
+    conn->scan_offset = 0;
+    conn->state = CONN_READING;
+
+    // Idle keep-alive connections are reaped after their own timeout
+    timer_set(conn, KEEPALIVE_TIMEOUT_SECONDS);
+
+    if (use_uring) {
+        // A RECV must only be armed once the buffer has settled: dispatch
+        // any pipelined request first, then rearm if we are still reading
+        conn_try_dispatch(conn);
+        if (conn->state == CONN_READING && !conn->read_armed) {
+            conn->read_armed = 1;
+            uring_queue_recv(conn);
+        }
+        return;
+    }
+
+    // Make sure we are watching for the next request again
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = conn;
+    epoll_ctl(conn->owner->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+
+    conn_try_dispatch(conn);
+}
+
+static void tls_handshake_continue(connection *conn);
+
+// Drain a reactor's completion list: connections whose responses the
+// workers have finished building and that are ready to be written out
+static void drain_completions(reactor *r) {
+    uint64_t count;
+    if (read(r->completion_event_fd, &count, sizeof(count)) == -1 &&
+        errno != EAGAIN) {
+        perror("Failed to drain completion eventfd");
+    }
+
+    pthread_mutex_lock(&r->completion_lock);
+    connection *conn = r->completion_head;
+    r->completion_head = NULL;
+    pthread_mutex_unlock(&r->completion_lock);
+
+    while (conn != NULL) {
+        connection *next = conn->next_done;
+        conn->next_done = NULL;
+        conn->in_worker = 0;
+        if (conn->defunct) {
+            close_connection(conn);
+        } else if (conn->state == CONN_TLS_HANDSHAKE) {
+            tls_handshake_continue(conn);
+        } else {
+            conn_start_write(conn);
+        }
+        conn = next;
+    }
+}
+
+// Read whatever the socket has, and dispatch once the request is complete.
+// Edge-triggered epoll means we must read until EAGAIN.
+static void conn_readable(connection *conn) {
+    while (conn->state == CONN_READING) {
+        ssize_t bytes_read = conn_recv_bytes(conn,
+                                  conn->in_buf + conn->in_len,
+                                  BUFFER_SIZE - 1 - conn->in_len);
+        if (bytes_read > 0) {
+            conn->in_len += bytes_read;
+            conn->in_buf[conn->in_len] = '\0';
+
+            // Headers complete?
+            if (conn_try_dispatch(conn)) {
+                return;
+            }
+            if (conn->in_len >= BUFFER_SIZE - 1) {
+                // Request too large for the buffer; give up on it
+                close_connection(conn);
+                return;
+            }
+        } else if (bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;  // No more data for now; wait for the next EPOLLIN
+        } else {
+            // EOF or error
+            close_connection(conn);
+            return;
+        }
+    }
+}
+
+// The socket drained enough to accept more of the response
+static void conn_writable(connection *conn) {
+    int flushed = conn_flush(conn);
+    if (flushed == 1) {
+        conn_finish_response(conn);
+    } else if (flushed == -1) {
+        close_connection(conn);
+    }
+}
+
+// Reactor-side follow-up after a handshake step: either the session is
+// up and the connection joins the normal read path, or we wait for
+// whichever socket direction the handshake asked for
+static void tls_handshake_continue(connection *conn) {
+    struct epoll_event event;
+    event.data.ptr = conn;
+    if (conn->tls_established) {
+        conn->state = CONN_READING;
+        event.events = EPOLLIN | EPOLLET;
+        epoll_ctl(conn->owner->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+        // The handshake may have pulled request bytes into the SSL
+        // buffer already; drain them now instead of waiting for an
+        // EPOLLIN that will never fire for them
+        conn_readable(conn);
+        return;
+    }
+    event.events = (conn->tls_want_write ? EPOLLOUT : EPOLLIN) | EPOLLET;
+    epoll_ctl(conn->owner->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+}
+
+// Socket activity during a handshake: hand the next step to a worker,
+// stepping inline when every queue is full (as conn_try_dispatch does)
+static void tls_handshake_dispatch(connection *conn) {
+    if (conn->in_worker) {
+        return;  // A worker is already stepping this handshake
+    }
+    conn->in_worker = 1;
+    if (dispatch_to_worker(conn) == -1) {
+        conn->in_worker = 0;
+        tls_handshake_step(conn);
+        if (conn->defunct) {
+            close_connection(conn);
+        } else {
+            tls_handshake_continue(conn);
+        }
+    }
+}
+
+// Accept every pending connection on a reactor's listening socket and
+// register each one with that reactor's event loop
+static void accept_connections(reactor *r) {
+    while (1) {
+        struct sockaddr_in address;
+        socklen_t addrlen = sizeof(address);
+        int client_socket = accept(r->listen_fd, (struct sockaddr*)&address, &addrlen);
+        if (client_socket == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;  // Drained the accept queue
+            }
+            perror("Accept failed");
+            break;
+        }
+
+        if (set_nonblocking(client_socket) == -1) {
+            perror("Failed to set client socket non-blocking");
+            close(client_socket);
+            continue;
+        }
+
+        connection *conn = conn_alloc();
+        if (conn == NULL) {
+            perror("Failed to allocate connection");
+            close(client_socket);
+            continue;
+        }
+        inet_ntop(AF_INET, &(address.sin_addr), conn->remote_addr,
+                  sizeof(conn->remote_addr));
+        log_debug("Client connected: %s:%d", conn->remote_addr,
+                  ntohs(address.sin_port));
+        conn->fd = client_socket;
+        conn->state = CONN_READING;
+        conn->file_fd = -1;
+        conn->owner = r;
+
+        if (tls_ctx != NULL) {
+            conn->ssl = SSL_new(tls_ctx);
+            if (conn->ssl == NULL) {
+                close(client_socket);
+                conn_slab_free(conn);
+                continue;
+            }
+            SSL_set_fd(conn->ssl, client_socket);
+            SSL_set_accept_state(conn->ssl);
+            conn->state = CONN_TLS_HANDSHAKE;
+        }
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLET;
+        event.data.ptr = conn;
+        if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, client_socket, &event) == -1) {
+            perror("Failed to add client socket to epoll");
+            close(client_socket);
+            conn_slab_free(conn);
+            continue;
+        }
+
+        __atomic_add_fetch(&active_connections, 1, __ATOMIC_RELAXED);
+
+        // A client that never sends a complete request gets reaped
+        timer_set(conn, READ_TIMEOUT_SECONDS);
+    }
+}
+
+// Build the TLS listener context: TLS 1.2+, the configured certificate
+// chain and key, and kTLS offload requested where OpenSSL and the kernel
+// support it. With kTLS the kernel carries the record layer after the
+// handshake, so writev() and sendfile() keep working — and staying
+// zero-copy — on TLS sockets. Kernels without the tls module fall back
+// to userspace records transparently.
+static void tls_init(void) {
+    tls_ctx = SSL_CTX_new(TLS_server_method());
+    if (tls_ctx == NULL) {
+        ERR_print_errors_fp(stderr);
+        exit(EXIT_FAILURE);
+    }
+    SSL_CTX_set_min_proto_version(tls_ctx, TLS1_2_VERSION);
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL_CTX_set_options(tls_ctx, SSL_OP_ENABLE_KTLS);
+#endif
+    // Partial writes match the non-blocking flush loops, which retry
+    // from wherever the previous attempt stopped
+    SSL_CTX_set_mode(tls_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                              SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    if (SSL_CTX_use_certificate_chain_file(tls_ctx, tls_cert_file) != 1 ||
+        SSL_CTX_use_PrivateKey_file(tls_ctx, tls_key_file,
+                                    SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(tls_ctx) != 1) {
+        ERR_print_errors_fp(stderr);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Create a non-blocking listening socket on PORT. With SO_REUSEPORT every
+// reactor binds its own socket to the same port and the kernel
+// load-balances incoming connections between them.
+static int create_listen_socket(void) {
+    int server_fd;
+    struct sockaddr_in address;
+
+    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Set socket options to reuse address, and the port across reactors
+    int opt = 1;
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+        perror("Setsockopt failed");
+        exit(EXIT_FAILURE);
+    }
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        perror("Setsockopt SO_REUSEPORT failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Setup server address structure
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(PORT);
+
+    // Bind socket to the port
+    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        perror("Bind failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // Listen for connections
+    if (listen(server_fd, 128) < 0) {
+        perror("Listen failed");
+        exit(EXIT_FAILURE);
+    }
+
+    if (set_nonblocking(server_fd) == -1) {
+        perror("Failed to set listening socket non-blocking");
+        exit(EXIT_FAILURE);
+    }
+
+    return server_fd;
+}
+
+// Set up one reactor: its listening socket, epoll instance, and
+// completion eventfd
+static void reactor_init(reactor *r) {
+    r->listen_fd = create_listen_socket();
+    pthread_mutex_init(&r->completion_lock, NULL);
+    r->timer_cursor = time(NULL);
+
+    r->epoll_fd = epoll_create1(0);
+    if (r->epoll_fd == -1) {
+        perror("Failed to create epoll instance");
+        exit(EXIT_FAILURE);
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = NULL;  // NULL marks the listening socket
+    if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->listen_fd, &event) == -1) {
+        perror("Failed to add listening socket to epoll");
+        exit(EXIT_FAILURE);
+    }
+
+    // Workers signal finished responses through this eventfd
+    r->completion_event_fd = eventfd(0, EFD_NONBLOCK);
+    if (r->completion_event_fd == -1) {
+        perror("Failed to create completion eventfd");
+        exit(EXIT_FAILURE);
+    }
+    event.events = EPOLLIN;
+    event.data.ptr = &completion_marker;
+    if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->completion_event_fd, &event) == -1) {
+        perror("Failed to add completion eventfd to epoll");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Event loop: multiplex accepts, reads, and writes for one reactor
+static void *reactor_run(void *arg) {
+    reactor *r = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1) {
+        // Wake at least once per second so the timer wheel keeps ticking
+        int num_events = epoll_wait(r->epoll_fd, events, MAX_EVENTS, 1000);
+        if (num_events == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
+            break;
+        }
+        timer_tick(r);
+
+        // Prefork drain: close the listener so SO_REUSEPORT routes new
+        // connections to the other workers, then exit once the last
+        // in-flight connection in this process completes
+        if (graceful_shutdown) {
+            if (r->listen_fd != -1) {
+                epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, r->listen_fd, NULL);
+                close(r->listen_fd);
+                r->listen_fd = -1;
+            }
+            if (__atomic_load_n(&active_connections, __ATOMIC_RELAXED) == 0) {
+                exit(0);
+            }
+        }
+
+        for (int i = 0; i < num_events; i++) {
+            connection *conn = events[i].data.ptr;
+
+            if (conn == NULL) {
+                accept_connections(r);
+            } else if ((void *)conn == &completion_marker) {
+                drain_completions(r);
+            } else if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                if (conn->in_worker) {
+                    // A worker still owns this connection; let the
+                    // completion path reap it
+                    conn->defunct = 1;
+                } else {
+                    close_connection(conn);
+                }
+            } else if (conn->state == CONN_TLS_HANDSHAKE) {
+                tls_handshake_dispatch(conn);
+            } else if (events[i].events & EPOLLOUT) {
+                conn_writable(conn);
+            } else if (events[i].events & EPOLLIN) {
+                conn_readable(conn);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// ------------------------- io_uring engine ---------------------------
+// Selectable with --engine uring. Same connection state machine, worker
+// pool, and response path as the epoll engine, but accepts and request
+// reads are completion-driven: SQEs accumulate while a batch of
+// completions is processed and go to the kernel in one io_uring_enter()
+// per loop iteration, instead of a syscall per ready socket. Responses
+// keep the writev()/sendfile() path — a POLL_ADD completion restarts the
+// flush when the socket backs up. Built on raw syscalls against
+// <linux/io_uring.h>: the server has no dependencies beyond libc, and
+// liburing would have been its first.
+
+#define URING_ENTRIES 256
+
+// CQE routing: a connection (or reactor) pointer in user_data, with an
+// operation tag in the low bits that malloc alignment leaves free
+#define URING_TAG_ACCEPT 1ull
+#define URING_TAG_RECV 2ull
+#define URING_TAG_POLLOUT 3ull
+#define URING_TAG_COMPLETIONS 4ull
+#define URING_TAG_TICK 5ull
+#define URING_TAG_MASK 7ull
+
+static struct {
+    int fd;
+    unsigned sq_entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // Peer address of the one in-flight accept
+    struct sockaddr_in accept_addr;
+    socklen_t accept_addrlen;
+
+    // The timer-wheel tick; one TIMEOUT op is always in flight
+    struct __kernel_timespec tick_ts;
+} uring;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+// Create the ring and map the submission/completion queues
+static void uring_init(void) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    uring.fd = sys_io_uring_setup(URING_ENTRIES, &p);
+    if (uring.fd == -1) {
+        perror("io_uring_setup failed (use --engine epoll on older kernels)");
+        exit(EXIT_FAILURE);
+    }
+    uring.sq_entries = p.sq_entries;
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_size > sq_size) {
+            sq_size = cq_size;
+        }
+    }
+
+    void *sq_ring = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, uring.fd,
+                         IORING_OFF_SQ_RING);
+    void *cq_ring = sq_ring;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq_ring = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, uring.fd,
+                       IORING_OFF_CQ_RING);
+    }
+    uring.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      uring.fd, IORING_OFF_SQES);
+    if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED ||
+        uring.sqes == MAP_FAILED) {
+        perror("Failed to map io_uring queues");
+        exit(EXIT_FAILURE);
+    }
+
+    uring.sq_head = (unsigned *)((char *)sq_ring + p.sq_off.head);
+    uring.sq_tail = (unsigned *)((char *)sq_ring + p.sq_off.tail);
+    uring.sq_mask = (unsigned *)((char *)sq_ring + p.sq_off.ring_mask);
+    uring.sq_array = (unsigned *)((char *)sq_ring + p.sq_off.array);
+    uring.cq_head = (unsigned *)((char *)cq_ring + p.cq_off.head);
+    uring.cq_tail = (unsigned *)((char *)cq_ring + p.cq_off.tail);
+    uring.cq_mask = (unsigned *)((char *)cq_ring + p.cq_off.ring_mask);
+    uring.cqes = (struct io_uring_cqe *)((char *)cq_ring + p.cq_off.cqes);
+}
+
+// Claim the next SQE, flushing the queue to the kernel first if full.
+// Submission itself is deferred to the event loop's io_uring_enter().
+static struct io_uring_sqe *uring_get_sqe(void) {
+    unsigned tail = *uring.sq_tail;
+    if (tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) ==
+        uring.sq_entries) {
+        if (sys_io_uring_enter(uring.fd, uring.sq_entries, 0, 0) == -1) {
+            perror("io_uring_enter failed");
+        }
+    }
+    struct io_uring_sqe *sqe = &uring.sqes[tail & *uring.sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    uring.sq_array[tail & *uring.sq_mask] = tail & *uring.sq_mask;
+    __atomic_store_n(uring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+// Keep exactly one accept in flight on the listening socket
+static void uring_queue_accept(reactor *r) {
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = r->listen_fd;
+    uring.accept_addrlen = sizeof(uring.accept_addr);
+    sqe->addr = (uint64_t)(uintptr_t)&uring.accept_addr;
+    sqe->addr2 = (uint64_t)(uintptr_t)&uring.accept_addrlen;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->user_data = (uint64_t)(uintptr_t)r | URING_TAG_ACCEPT;
+}
+
+static void uring_queue_recv(connection *conn) {
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(conn->in_buf + conn->in_len);
+    sqe->len = (uint32_t)(BUFFER_SIZE - 1 - conn->in_len);
+    sqe->user_data = (uint64_t)(uintptr_t)conn | URING_TAG_RECV;
+}
+
+static void uring_queue_pollout(connection *conn) {
+    conn->write_armed = 1;
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = conn->fd;
+    sqe->poll_events = POLLOUT;
+    sqe->user_data = (uint64_t)(uintptr_t)conn | URING_TAG_POLLOUT;
+}
+
+static void uring_queue_completions_poll(reactor *r) {
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = r->completion_event_fd;
+    sqe->poll_events = POLLIN;
+    sqe->user_data = (uint64_t)(uintptr_t)r | URING_TAG_COMPLETIONS;
+}
+
+// One-second heartbeat so the timer wheel ticks while the ring sleeps
+static void uring_queue_tick(reactor *r) {
+    uring.tick_ts.tv_sec = 1;
+    uring.tick_ts.tv_nsec = 0;
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)&uring.tick_ts;
+    sqe->len = 1;
+    sqe->user_data = (uint64_t)(uintptr_t)r | URING_TAG_TICK;
+}
+
+// A connection arrived; res is the accepted fd (or a negated errno)
+static void uring_handle_accept(reactor *r, int res) {
+    if (r->listen_fd == -1) {
+        // Draining: the listener is gone and the in-flight accept came
+        // back canceled; do not re-arm it
+        if (res >= 0) {
+            close(res);
+        }
+        return;
+    }
+    if (res >= 0) {
+        connection *conn = conn_alloc();
+        if (conn == NULL) {
+            perror("Failed to allocate connection");
+            close(res);
+        } else {
+            inet_ntop(AF_INET, &uring.accept_addr.sin_addr, conn->remote_addr,
+                      sizeof(conn->remote_addr));
+            log_debug("Client connected: %s:%d", conn->remote_addr,
+                      ntohs(uring.accept_addr.sin_port));
+            conn->fd = res;
+            conn->state = CONN_READING;
+            conn->file_fd = -1;
+            conn->owner = r;
+            conn->read_armed = 1;
+            __atomic_add_fetch(&active_connections, 1, __ATOMIC_RELAXED);
+            uring_queue_recv(conn);
+            timer_set(conn, READ_TIMEOUT_SECONDS);
+        }
+    } else if (res != -EAGAIN && res != -ECONNABORTED) {
+        log_printf("Accept failed: %s", strerror(-res));
+    }
+    uring_queue_accept(r);
+}
+
+// Request bytes landed in in_buf; the completion-driven counterpart of
+// conn_readable(), one chunk per completion
+static void uring_handle_recv(connection *conn, int res) {
+    conn->read_armed = 0;
+    if (res <= 0) {
+        // EOF or error
+        close_connection(conn);
+        return;
+    }
+    conn->in_len += (size_t)res;
+    conn->in_buf[conn->in_len] = '\0';
+
+    if (conn_try_dispatch(conn)) {
+        return;  // The response path owns the connection now
+    }
+    if (conn->in_len >= BUFFER_SIZE - 1) {
+        // Request too large for the buffer; give up on it
+        close_connection(conn);
+        return;
+    }
+    conn->read_armed = 1;
+    uring_queue_recv(conn);
+}
+
+// Event loop: submit whatever the handlers queued, wait for at least one
+// completion, and dispatch the batch
+static void uring_run(reactor *r) {
+    uring_init();
+    uring_queue_accept(r);
+    uring_queue_completions_poll(r);
+    uring_queue_tick(r);
+
+    while (1) {
+        unsigned pending =
+            *uring.sq_tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE);
+        if (sys_io_uring_enter(uring.fd, pending, 1,
+                               IORING_ENTER_GETEVENTS) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("io_uring_enter failed");
+            break;
+        }
+
+        unsigned head = *uring.cq_head;
+        while (head != __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &uring.cqes[head & *uring.cq_mask];
+            uint64_t data = cqe->user_data;
+            int res = cqe->res;
+            head++;
+            __atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+
+            void *ptr = (void *)(uintptr_t)(data & ~URING_TAG_MASK);
+            switch (data & URING_TAG_MASK) {
+            case URING_TAG_ACCEPT:
+                uring_handle_accept(ptr, res);
+                break;
+            case URING_TAG_RECV:
+                uring_handle_recv(ptr, res);
+                break;
+            case URING_TAG_POLLOUT:
+                // Socket drained (or errored; the flush finds out):
+                // resume sending. POLL_ADD is one-shot, and this rearms
+                // it if the socket fills again.
+                ((connection *)ptr)->write_armed = 0;
+                conn_start_write(ptr);
+                break;
+            case URING_TAG_COMPLETIONS:
+                drain_completions(ptr);
+                uring_queue_completions_poll(ptr);
+                break;
+            case URING_TAG_TICK:
+                timer_tick(ptr);
+                uring_queue_tick(ptr);
+                break;
+            }
+        }
+
+        // Prefork drain, as in the epoll loop: stop accepting, then
+        // exit when the last in-flight connection completes
+        if (graceful_shutdown) {
+            if (r->listen_fd != -1) {
+                close(r->listen_fd);
+                r->listen_fd = -1;
+            }
+            if (__atomic_load_n(&active_connections, __ATOMIC_RELAXED) == 0) {
+                exit(0);
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Startup cache preloading. A deploy restart otherwise serves its first
+// minutes of traffic from cold caches, paying full disk I/O per request
+// until the hot set is resident. Before listen(), the www tree is
+// walked once and every file pushed through the same stat-cache and
+// file-cache insert paths a request would take, split across a few
+// threads so a large tree warms in seconds. The negative stat entries
+// behind the .br/.gz variant probes are warmed too.
+
+#define PRELOAD_THREADS 4
+
+typedef struct {
+    char **paths;
+    size_t count;
+    size_t next;  // Claimed atomically by the preload threads
+} preload_state;
+
+// Collect every regular file under dir_path (directories go straight
+// into the stat cache as they are found)
+static void preload_collect(const char *dir_path, char ***paths,
+                            size_t *count, size_t *capacity) {
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) {
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        char path[MAX_PATH_LENGTH];
+        int len = snprintf(path, sizeof(path), "%s/%s", dir_path, ent->d_name);
+        if (len < 0 || len >= MAX_PATH_LENGTH) {
+            continue;
+        }
+        struct stat st;
+        if (stat(path, &st) == -1) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            stat_cache_store(path, &st, -1);
+            preload_collect(path, paths, count, capacity);
+        } else if (S_ISREG(st.st_mode)) {
+            if (*count == *capacity) {
+                *capacity = *capacity > 0 ? *capacity * 2 : 256;
+                *paths = realloc(*paths, *capacity * sizeof(char *));
+                if (*paths == NULL) {
+                    perror("Failed to grow preload list");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            (*paths)[(*count)++] = strdup(path);
+        }
+    }
+    closedir(dir);
+}
+
+// Warm one file through the regular insert paths, plus the negative
+// entries the variant probes will ask for
+static void preload_file(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        stat_cache_store(path, &st, fd);
+        file_cache_insert(path, fd, &st);
+    }
+    close(fd);
+
+    // Probe the precompressed siblings so the first real request pays
+    // nothing for them either way; existing variants were collected as
+    // files of their own
+    for (size_t i = 0;
+         i < sizeof(content_codings) / sizeof(content_codings[0]); i++) {
+        char variant[MAX_PATH_LENGTH];
+        int len = snprintf(variant, sizeof(variant), "%s%s", path,
+                           content_codings[i].suffix);
+        if (len >= 0 && len < MAX_PATH_LENGTH) {
+            file_exists(variant);
+        }
+    }
+}
+
+static void *preload_worker(void *arg) {
+    preload_state *state = arg;
+    while (1) {
+        size_t i = __atomic_fetch_add(&state->next, 1, __ATOMIC_RELAXED);
+        if (i >= state->count) {
+            break;
+        }
+        preload_file(state->paths[i]);
+    }
+    return NULL;
+}
+
+static void preload_caches(void) {
+    preload_state state = { NULL, 0, 0 };
+    size_t capacity = 0;
+    preload_collect(WWW_DIRECTORY, &state.paths, &state.count, &capacity);
+    if (state.count == 0) {
+        free(state.paths);
+        return;
+    }
+
+    pthread_t threads[PRELOAD_THREADS];
+    int started = 0;
+    for (int i = 0; i < PRELOAD_THREADS; i++) {
+        if (pthread_create(&threads[i], NULL, preload_worker, &state) == 0) {
+            started++;
+        } else {
+            break;
+        }
+    }
+    if (started == 0) {
+        preload_worker(&state);  // Degrade to warming inline
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    printf("Preloaded %zu files from %s\n", state.count, WWW_DIRECTORY);
+
+    for (size_t i = 0; i < state.count; i++) {
+        free(state.paths[i]);
+    }
+    free(state.paths);
+}
+
+// ---------------------------------------------------------------------------
+// Prefork supervisor (--prefork N). Each worker is a separate process
+// running the full server — its own reactors, threads, and caches —
+// bound to the shared port through SO_REUSEPORT, so a segfault in one
+// (or a wedged PHP child) costs 1/Nth of capacity until the supervisor
+// respawns it a moment later, instead of a full outage. Workers are
+// started by exec'ing the binary from disk, which makes SIGHUP a true
+// binary reload: a fresh set is exec'd from whatever is on disk now,
+// and the old set drains its in-flight connections before exiting.
+
+static volatile sig_atomic_t supervisor_reload;
+static volatile sig_atomic_t supervisor_quit;
+
+static void supervisor_signal(int sig) {
+    if (sig == SIGHUP) {
+        supervisor_reload = 1;
+    } else {
+        supervisor_quit = 1;
+    }
+}
+
+static void prefork_child_terminate(int sig) {
+    (void)sig;
+    graceful_shutdown = 1;
+}
+
+static pid_t prefork_spawn(char **child_argv) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execv(child_argv[0], child_argv);
+        perror("Failed to exec worker process");
+        _exit(EXIT_FAILURE);
+    }
+    if (pid == -1) {
+        perror("Failed to fork worker process");
+    }
+    return pid;
+}
+
+// Run the supervisor loop. Never returns: the serving processes are the
+// exec'd workers, which parse the same command line with --prefork
+// replaced by the internal --prefork-child marker.
+static void prefork_supervise(int argc, char *argv[]) {
+    char **child_argv = calloc((size_t)argc + 2, sizeof(char *));
+    if (child_argv == NULL) {
+        perror("Failed to allocate worker argv");
+        exit(EXIT_FAILURE);
+    }
+    int n = 0;
+    child_argv[n++] = argv[0];
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--prefork") == 0 && i + 1 < argc) {
+            i++;  // Drop the flag and its count
+            continue;
+        }
+        child_argv[n++] = argv[i];
+    }
+    child_argv[n++] = "--prefork-child";
+    child_argv[n] = NULL;
+
+    // No SA_RESTART: SIGHUP/SIGTERM must interrupt the waitpid() below
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = supervisor_signal;
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    pid_t *pids = calloc((size_t)num_prefork, sizeof(pid_t));
+    if (pids == NULL) {
+        perror("Failed to allocate worker pid table");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < num_prefork; i++) {
+        pids[i] = prefork_spawn(child_argv);
+    }
+    printf("Supervisor %d started %d worker processes\n", (int)getpid(),
+           num_prefork);
+    fflush(stdout);
+
+    while (!supervisor_quit) {
+        int status;
+        pid_t dead = waitpid(-1, &status, 0);
+        if (dead == -1) {
+            if (errno == EINTR && supervisor_reload) {
+                supervisor_reload = 0;
+                // Graceful reload: exec the fresh set first, then ask
+                // the old set to drain. SO_REUSEPORT keeps the port
+                // served throughout, so no connection window is lost.
+                printf("Reloading: starting %d fresh workers\n", num_prefork);
+                fflush(stdout);
+                for (int i = 0; i < num_prefork; i++) {
+                    pid_t old = pids[i];
+                    pids[i] = prefork_spawn(child_argv);
+                    if (old > 0) {
+                        kill(old, SIGTERM);
+                    }
+                }
+            } else if (errno == ECHILD) {
+                sleep(1);  // Every spawn failed; retry below via respawn
+            }
+            continue;
+        }
+        // A worker from the current set died: respawn it to restore
+        // capacity. Old-generation workers finishing a drain after a
+        // reload are reaped here without comment.
+        for (int i = 0; i < num_prefork; i++) {
+            if (pids[i] == dead) {
+                fprintf(stderr,
+                        "Worker %d exited unexpectedly (status %d); respawning\n",
+                        (int)dead, status);
+                pids[i] = prefork_spawn(child_argv);
+                break;
+            }
+        }
+    }
+
+    // Shut down: ask every worker to drain, then wait for them all
+    for (int i = 0; i < num_prefork; i++) {
+        if (pids[i] > 0) {
+            kill(pids[i], SIGTERM);
+        }
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) {
+    }
+    exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    // A client that disconnects mid-response must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    mime_table_init();
+
+    // Parse command-line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--reactors") == 0 && i + 1 < argc) {
+            num_reactors = atoi(argv[++i]);
+            if (num_reactors < 1) {
+                fprintf(stderr, "Invalid reactor count: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "uring") == 0) {
+                use_uring = 1;
+            } else if (strcmp(argv[i], "epoll") != 0) {
+                fprintf(stderr, "Unknown engine: %s (epoll, uring)\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--php-cache-ttl") == 0 && i + 1 < argc) {
+            php_cache_ttl = atoi(argv[++i]);
+            if (php_cache_ttl < 0) {
+                fprintf(stderr, "Invalid PHP cache TTL: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--prefork") == 0 && i + 1 < argc) {
+            num_prefork = atoi(argv[++i]);
+            if (num_prefork < 1) {
+                fprintf(stderr, "Invalid prefork count: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--prefork-child") == 0) {
+            prefork_child = 1;
+        } else if (strcmp(argv[i], "--tls-cert") == 0 && i + 1 < argc) {
+            tls_cert_file = argv[++i];
+        } else if (strcmp(argv[i], "--tls-key") == 0 && i + 1 < argc) {
+            tls_key_file = argv[++i];
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            quiet = 1;
+        } else {
+            fprintf(stderr,
+                    "Usage: %s [--reactors N] [--engine epoll|uring] "
+                    "[--prefork N] [--php-cache-ttl SECONDS] "
+                    "[--tls-cert PEM --tls-key PEM] [--quiet]\n",
+                    argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Prefork mode: this process becomes the supervisor and never serves
+    // traffic itself; everything below runs in the exec'd workers
+    if (num_prefork > 0 && !prefork_child) {
+        prefork_supervise(argc, argv);
+    }
+    if (prefork_child) {
+        // Drain on SIGTERM. No SA_RESTART, so a reactor blocked in
+        // epoll_wait() or io_uring_enter() wakes to see the flag.
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = prefork_child_terminate;
+        sigaction(SIGTERM, &sa, NULL);
+    }
+
+    if (tls_cert_file != NULL || tls_key_file != NULL) {
+        if (tls_cert_file == NULL || tls_key_file == NULL) {
+            fprintf(stderr, "--tls-cert and --tls-key must be given together\n");
+            exit(EXIT_FAILURE);
+        }
+        // The uring read path has no hook for the record layer yet
+        if (use_uring) {
+            fprintf(stderr, "--engine uring does not support TLS; using epoll\n");
+            use_uring = 0;
+        }
+        tls_init();
+    }
+
+    // The uring engine drives a single ring from the main thread
+    if (use_uring && num_reactors > 1) {
+        fprintf(stderr, "--engine uring runs a single reactor; ignoring --reactors\n");
+        num_reactors = 1;
+    }
+
+    // Check if PHP is installed
+    if (access(PHP_CLI, X_OK) != 0) {
+        printf("Warning: PHP CLI (%s) not found or not executable.\n", PHP_CLI);
+        printf("PHP scripts will not be processed correctly.\n");
+        printf("Please install PHP or update the PHP_CLI path in the code.\n\n");
+    }
+
+    // Create www directory if it doesn't exist
+    struct stat st = {0};
+    if (stat(WWW_DIRECTORY, &st) == -1) {
+        printf("Creating www directory...\n");
+        mkdir(WWW_DIRECTORY, 0700);
+
+        // Create a sample index.html file
+        char index_path[MAX_PATH_LENGTH];
+        snprintf(index_path, MAX_PATH_LENGTH, "%s/index.html", WWW_DIRECTORY);
+        FILE *index_file = fopen(index_path, "w");
+        if (index_file) {
+            fprintf(index_file,
+                "<!DOCTYPE html>\n"
+                "<html>\n"
+                "<head>\n"
+                "    <title>Welcome to C HTTP Server</title>\n"
+                "</head>\n"
+                "<body>\n"
+                "    <h1>Welcome to C HTTP Server</h1>\n"
+                "    <p>This is a sample HTML file being served by your C HTTP server.</p>\n"
+                "    <p>Place your HTML files in the 'www' directory to serve them.</p>\n"
+                "</body>\n"
+                "</html>\n");
+            fclose(index_file);
+            printf("Created sample index.html file.\n");
+        }
+
+        // Create a sample PHP file
+        char php_path[MAX_PATH_LENGTH];
+        snprintf(php_path, MAX_PATH_LENGTH, "%s/info.php", WWW_DIRECTORY);
+        FILE *php_file = fopen(php_path, "w");
+        if (php_file) {
+            fprintf(php_file,
+                "<?php\n"
+                "    echo \"<h1>PHP is working!</h1>\";\n"
+                "    echo \"<p>This is generated by PHP running on your C HTTP server.</p>\";\n"
+                "    echo \"<h2>PHP Information</h2>\";\n"
+                "    phpinfo();\n"
+                "?>\n");
+            fclose(php_file);
+            printf("Created sample info.php file.\n");
+        }
+    }
+
+    // Warm the caches before the listening sockets exist, so the first
+    // request after a restart performs like the ten-thousandth
+    preload_caches();
+
+    // Set up the reactors, each with its own SO_REUSEPORT listening socket
+    reactors = calloc(num_reactors, sizeof(reactor));
+    if (reactors == NULL) {
+        perror("Failed to allocate reactors");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < num_reactors; i++) {
+        reactor_init(&reactors[i]);
+    }
+
+    start_workers();
+    start_logger();
+
+    const char *scheme = tls_ctx != NULL ? "https" : "http";
+    printf("Server started at %s://localhost:%d\n", scheme, PORT);
+    printf("Serving files from %s\n", WWW_DIRECTORY);
+    printf("Running %d reactor%s (%s engine%s)\n", num_reactors,
+           num_reactors == 1 ? "" : "s", use_uring ? "io_uring" : "epoll",
+           tls_ctx != NULL ? ", TLS" : "");
+    printf("Try visiting: %s://localhost:%d/ for the HTML sample\n", scheme, PORT);
+    printf("Try visiting: %s://localhost:%d/info.php for the PHP sample\n", scheme, PORT);
+    printf("Press Ctrl+C to stop the server\n");
+    // The logger thread writes to fd 1 directly; flush the stdio banner
+    // so the two streams cannot interleave mid-line (and so a fork for
+    // the PHP CLI fallback never inherits unflushed output)
+    fflush(stdout);
+
+    if (use_uring) {
+        uring_run(&reactors[0]);
+        return 0;
+    }
+
+    // Spawn the extra reactors; the main thread runs the first one
+    for (int i = 1; i < num_reactors; i++) {
+        if (pthread_create(&reactors[i].thread, NULL, reactor_run,
+                           &reactors[i]) != 0) {
+            perror("Failed to start reactor thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+    reactor_run(&reactors[0]);
+
+    return 0;
+}